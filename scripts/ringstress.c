@@ -0,0 +1,184 @@
+/**
+ * @file scripts/ringstress.c
+ * Host-side stress test for lib/ring.
+ *
+ * A producer thread and a consumer thread move sequenced elements through
+ * a small ring with bulk sizes picked at random on each side, so the
+ * counters wrap and the copies split at the end of the storage all the
+ * time.  Elements are 12 bytes, which is not a power of two, and each one
+ * carries its sequence number and a check value.  The consumer fails on
+ * the first element that is missing, repeated, out of order or torn.
+ *
+ * Built and run on the host with make ringstress.
+ *
+ * Usage: ringstress [elements] [capacity]
+ *
+ * Exits 0 if every element arrived in order, 1 otherwise.
+ * @author Conlan Wesson
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ring.h"
+
+#define STRESS_ELEMENTS 5000000u    //!< Elements to move by default.
+#define STRESS_CAPACITY 64u         //!< Ring capacity by default.
+#define STRESS_BULK_MAX 48u         //!< Largest bulk push or pop.
+
+/**
+ * Element moved through the ring.
+ */
+typedef struct stress_elem{
+	uint32_t seq;      //!< Sequence number.
+	uint32_t check;    //!< Derived from seq, catches torn copies.
+	uint32_t pad;      //!< Makes the element 12 bytes.
+} stress_elem;
+
+/**
+ * State shared by the two threads.
+ */
+typedef struct stress{
+	ring r;            //!< The ring under test.
+	uint32_t total;    //!< Elements to move.
+	bool failed;       //!< The consumer found a bad element.
+} stress;
+
+/**
+ * Gets the check value of a sequence number.
+ * @param seq The sequence number.
+ * @return The check value.
+ */
+static inline uint32_t stress_check(uint32_t seq){
+	return seq*2654435761u ^ 0xA5A5A5A5u;
+}
+
+/**
+ * Picks a bulk size.
+ * @param state Random state of the calling thread.
+ * @return A size from 1 to STRESS_BULK_MAX.
+ */
+static uint32_t stress_bulk(uint32_t *state){
+	// xorshift32, each thread keeps its own state.
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return 1 + x % STRESS_BULK_MAX;
+}
+
+/**
+ * Pushes every element, single and bulk.
+ * @param arg The shared state.
+ * @return NULL.
+ */
+static void *stress_producer(void *arg){
+	stress *s = arg;
+	stress_elem batch[STRESS_BULK_MAX];
+	uint32_t state = 0x12345678u;
+	uint32_t seq = 0;
+	while(seq < s->total && !__atomic_load_n(&s->failed, __ATOMIC_RELAXED)){
+		uint32_t count = stress_bulk(&state);
+		if(count > s->total - seq){
+			count = s->total - seq;
+		}
+		for(uint32_t i = 0; i < count; ++i){
+			batch[i].seq = seq + i;
+			batch[i].check = stress_check(seq + i);
+			batch[i].pad = ~(seq + i);
+		}
+		uint32_t sent;
+		if(count == 1){
+			sent = ring_push(&s->r, &batch[0]) ? 1 : 0;
+		}else{
+			sent = ring_push_bulk(&s->r, batch, count);
+		}
+		if(!sent){
+			sched_yield();
+		}
+		seq += sent;
+	}
+	return NULL;
+}
+
+/**
+ * Pops every element, single and bulk, and checks them.
+ * @param arg The shared state.
+ * @return NULL if every element arrived in order.
+ */
+static void *stress_consumer(void *arg){
+	stress *s = arg;
+	stress_elem batch[STRESS_BULK_MAX];
+	uint32_t state = 0x9E3779B9u;
+	uint32_t seq = 0;
+	while(seq < s->total){
+		uint32_t count = stress_bulk(&state);
+		uint32_t got;
+		if(count == 1){
+			got = ring_pop(&s->r, &batch[0]) ? 1 : 0;
+		}else{
+			got = ring_pop_bulk(&s->r, batch, count);
+		}
+		if(!got){
+			sched_yield();
+		}
+		if(ring_count(&s->r) > s->r.mask + 1){
+			fprintf(stderr, "ring count %u exceeds capacity\n", ring_count(&s->r));
+			__atomic_store_n(&s->failed, true, __ATOMIC_RELAXED);
+			return s;
+		}
+		for(uint32_t i = 0; i < got; ++i, ++seq){
+			const stress_elem *e = &batch[i];
+			if(e->seq != seq || e->check != stress_check(seq) || e->pad != ~seq){
+				fprintf(stderr, "element %u: got seq %u check %08X pad %08X\n", seq, e->seq, e->check, e->pad);
+				__atomic_store_n(&s->failed, true, __ATOMIC_RELAXED);
+				return s;
+			}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Runs the stress test.
+ * @param argc Number of arguments.
+ * @param argv Number of elements and ring capacity, both optional.
+ * @return 0 if successful, 1 if the test failed, 2 on bad arguments.
+ */
+int main(int argc, char **argv){
+	uint32_t capacity = STRESS_CAPACITY;
+	static stress s;
+	s.total = STRESS_ELEMENTS;
+	if(argc > 1){
+		s.total = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+	if(argc > 2){
+		capacity = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+	
+	stress_elem *data = calloc(capacity, sizeof(stress_elem));
+	if(data == NULL || ring_init(&s.r, data, capacity, sizeof(stress_elem)) != EOK){
+		fprintf(stderr, "Cannot make a ring of %u elements\n", capacity);
+		return 2;
+	}
+	// Start near the wrap of the free-running counters.
+	s.r.head = s.r.tail = UINT32_MAX - 1000;
+	
+	pthread_t producer, consumer;
+	pthread_create(&consumer, NULL, stress_consumer, &s);
+	pthread_create(&producer, NULL, stress_producer, &s);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	free(data);
+	
+	if(s.failed || ring_count(&s.r) != 0){
+		printf("FAIL: %u elements through a %u slot ring\n", s.total, capacity);
+		return 1;
+	}
+	printf("OK: %u elements through a %u slot ring\n", s.total, capacity);
+	return 0;
+}
@@ -18,6 +18,7 @@ device_descriptor bda_desc = {
 	MIN_ADDR, MAX_ADDR,
 	0, 0,
 	bda_read, 0,
+	0, 0, 0,
 	0, 0, 0
 };
 
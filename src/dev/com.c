@@ -7,9 +7,11 @@
 #include "com.h"
 
 #include <errno.h>
+#include <kernel/int.h>
 #include <kernel/ioport.h>
-#include <queue.h>
+#include <ring.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "sys/interrupt/isr.h"
 
@@ -18,51 +20,165 @@
 #define COM_PORT_3 0x03E8    //!< I/O port for COM3.
 #define COM_PORT_4 0x02E8    //!< I/O port for COM4.
 
-#define COM_DATA_5 0x00
-#define COM_DATA_6 0x01
-#define COM_DATA_7 0x02
-#define COM_DATA_8 0x03
+/**
+ * UART register offsets from the base port.
+ */
+enum {
+	COM_REG_DATA    = 0,    //!< Receive/transmit holding, divisor low with DLAB.
+	COM_REG_IER     = 1,    //!< Interrupt enable, divisor high with DLAB.
+	COM_REG_IIR     = 2,    //!< Interrupt identification when read.
+	COM_REG_FCR     = 2,    //!< FIFO control when written.
+	COM_REG_LCR     = 3,    //!< Line control.
+	COM_REG_MCR     = 4,    //!< Modem control.
+	COM_REG_LSR     = 5,    //!< Line status.
+	COM_REG_MSR     = 6,    //!< Modem status.
+	COM_REG_SCRATCH = 7     //!< Scratch register.
+};
+
+#define COM_DLAB 0x80    //!< Line control bit selecting the divisor latch.
+
+#define COM_IER_RX     0x01    //!< Interrupt when data is received.
+#define COM_IER_TX     0x02    //!< Interrupt when the transmit holding register empties.
+#define COM_IER_LINE   0x04    //!< Interrupt on line status errors.
+
+#define COM_IIR_NONE   0x01    //!< No interrupt is pending.
+#define COM_IIR_MASK   0x0E    //!< Interrupt identification bits.
+#define COM_IIR_MODEM  0x00    //!< Modem status changed.
+#define COM_IIR_TX     0x02    //!< Transmit holding register empty.
+#define COM_IIR_RX     0x04    //!< Received data reached the trigger level.
+#define COM_IIR_LINE   0x06    //!< Line status error.
+#define COM_IIR_TIMEOUT 0x0C   //!< Received data waiting below the trigger level.
+
+#define COM_FCR_ENABLE 0x01    //!< Enable the FIFOs.
+#define COM_FCR_CLEAR  0x06    //!< Clear both FIFOs.
 
-#define COM_STOP_1 0x00
-#define COM_STOP_2 0x04
+#define COM_MCR_READY  0x0B    //!< DTR, RTS and OUT2, which gates the IRQ line.
+
+#define COM_LSR_DATA   0x01    //!< Received data is waiting.
+#define COM_LSR_THRE   0x20    //!< Transmit holding register and FIFO are empty.
+#define COM_LSR_TEMT   0x40    //!< Transmitter is completely idle.
+
+#define COM_FIFO_SIZE   16     //!< Bytes the transmit FIFO holds.
+#define COM_BUFFER_SIZE 1024   //!< Bytes in each ring, must be a power of two.
+
+/**
+ * State of one COM port.
+ */
+typedef struct com_state{
+	uint16_t port;          //!< Base I/O port.
+	bool open;              //!< Port has been opened.
+	uint8_t ier;            //!< Interrupts currently enabled.
+	uint8_t fcr;            //!< FIFO control value.
+	uint32_t overruns;      //!< Received bytes dropped because the ring was full.
+	ring rx;                //!< Received bytes, filled by the ISR.
+	ring tx;                //!< Bytes to send, drained by the ISR.
+} com_state;
 
-#define COM_DLAB 0x80
-#define COM_BUFFER_SIZE 256
-#define COM_INTERRUPT_ENABLE 0x03
+//! Storage for the receive rings.
+static uint8_t com_rx_data[4][COM_BUFFER_SIZE];
+//! Storage for the transmit rings.
+static uint8_t com_tx_data[4][COM_BUFFER_SIZE];
 
-static bool is_open[4] = {false, false, false, false};
+//! COM port state, COM1 first.
+static com_state coms[4] = {
+	{.port = COM_PORT_1},
+	{.port = COM_PORT_2},
+	{.port = COM_PORT_3},
+	{.port = COM_PORT_4}
+};
+
+/**
+ * Gets the state of an open COM port.
+ * @param line The COM port number (1-4).
+ * @return The port state, or NULL if the port is not open.
+ */
+static com_state *com_get(uint8_t line){
+	if(line < 1 || line > 4 || !coms[line-1].open){
+		return NULL;
+	}
+	return &coms[line-1];
+}
+
+/**
+ * Moves bytes from the transmit ring into an empty transmit FIFO.
+ * The transmit interrupt stays enabled only while bytes are waiting.
+ * Must be called with interrupts disabled.
+ * @param com The port to transmit on.
+ */
+static void com_transmit(com_state *com){
+	if(inb(com->port + COM_REG_LSR) & COM_LSR_THRE){
+		uint8_t fifo[COM_FIFO_SIZE];
+		uint32_t count = ring_pop_bulk(&com->tx, fifo, COM_FIFO_SIZE);
+		for(uint32_t i = 0; i < count; ++i){
+			outb(com->port + COM_REG_DATA, fifo[i]);
+		}
+	}
+	uint8_t ier = ring_count(&com->tx) ? (com->ier | COM_IER_TX) : (com->ier & ~COM_IER_TX);
+	if(ier != com->ier){
+		com->ier = ier;
+		outb(com->port + COM_REG_IER, ier);
+	}
+}
 
-static queue buffer_in[4];
-static int buff_data_in[4][COM_BUFFER_SIZE];
-static queue buffer_out[4];
-static int buff_data_out[4][COM_BUFFER_SIZE];
+/**
+ * Moves received bytes from the receive FIFO into the receive ring.
+ * @param com The port to receive on.
+ */
+static void com_receive(com_state *com){
+	uint8_t fifo[COM_FIFO_SIZE];
+	uint32_t count;
+	do{
+		count = 0;
+		while(count < COM_FIFO_SIZE && (inb(com->port + COM_REG_LSR) & COM_LSR_DATA)){
+			fifo[count++] = inb(com->port + COM_REG_DATA);
+		}
+		com->overruns += count - ring_push_bulk(&com->rx, fifo, count);
+	}while(count == COM_FIFO_SIZE);
+}
 
+/**
+ * Handles interrupts from the COM ports sharing an IRQ.
+ * @param regs Registers from before the interrupt.
+ */
 static void com_isr(isr_regs regs){
-	(void)regs;
-	
+	// COM1 and COM3 share IRQ4, COM2 and COM4 share IRQ3.
+	int first = (regs.int_no == IRQ4) ? 0 : 1;
+	for(int i = first; i < 4; i += 2){
+		com_state *com = &coms[i];
+		if(!com->open){
+			continue;
+		}
+		uint8_t iir;
+		while(!((iir = inb(com->port + COM_REG_IIR)) & COM_IIR_NONE)){
+			switch(iir & COM_IIR_MASK){
+				case COM_IIR_RX:
+				case COM_IIR_TIMEOUT:
+					com_receive(com);
+					break;
+				case COM_IIR_TX:
+					com_transmit(com);
+					break;
+				case COM_IIR_LINE:
+					inb(com->port + COM_REG_LSR);
+					break;
+				default:
+					inb(com->port + COM_REG_MSR);
+					break;
+			}
+		}
+	}
 }
 
 /**
  * Initial setup of COM devices.
  */
 void com_init(){
-	// Disable interrupts.
-	outb(COM_PORT_1 + 1, 0x00);
-	outb(COM_PORT_2 + 1, 0x00);
-	outb(COM_PORT_3 + 1, 0x00);
-	outb(COM_PORT_4 + 1, 0x00);
-	
-	// Setup input queues.
-	new_queue(&buffer_in[0], (int*)&buff_data_in[0], COM_BUFFER_SIZE);
-	new_queue(&buffer_in[1], (int*)&buff_data_in[1], COM_BUFFER_SIZE);
-	new_queue(&buffer_in[2], (int*)&buff_data_in[2], COM_BUFFER_SIZE);
-	new_queue(&buffer_in[3], (int*)&buff_data_in[3], COM_BUFFER_SIZE);
-	
-	// Setup output queues.
-	new_queue(&buffer_out[0], (int*)&buff_data_out[0], COM_BUFFER_SIZE);
-	new_queue(&buffer_out[1], (int*)&buff_data_out[1], COM_BUFFER_SIZE);
-	new_queue(&buffer_out[2], (int*)&buff_data_out[2], COM_BUFFER_SIZE);
-	new_queue(&buffer_out[3], (int*)&buff_data_out[3], COM_BUFFER_SIZE);
+	// Disable interrupts, ports opened during early boot keep theirs.
+	for(int i = 0; i < 4; ++i){
+		if(!coms[i].open){
+			outb(coms[i].port + COM_REG_IER, 0x00);
+		}
+	}
 	
 	// Register interrupt handlers.
 	isr_register(IRQ4, &com_isr);
@@ -80,9 +196,12 @@ void com_init(){
  */
 bool com_open(uint8_t line, uint32_t baud, uint8_t data, uint8_t stop, com_parity parity){
 	// Determine the rate divisor.
-	uint16_t divisor = baud / COM_BAUD_MAX;
-	uint8_t divlo = (divisor & 0x0F);
-	uint8_t divhi = (divisor & 0xF0) >> 8;
+	if(baud == 0 || baud > COM_BAUD_MAX || COM_BAUD_MAX % baud){
+		return false;
+	}
+	uint16_t divisor = COM_BAUD_MAX / baud;
+	uint8_t divlo = (divisor & 0xFF);
+	uint8_t divhi = (divisor >> 8) & 0xFF;
 	
 	// Determine the data bit setting.
 	if(data >= 5 && data <= 8){
@@ -98,58 +217,78 @@ bool com_open(uint8_t line, uint32_t baud, uint8_t data, uint8_t stop, com_parit
 		return false;
 	}
 	
-	// Determine the IO port.
-	uint16_t port = 0;
-	if(line == 1){
-		port = COM_PORT_1;
-	}else if(line == 2){
-		port = COM_PORT_2;
-	}else if(line == 3){
-		port = COM_PORT_3;
-	}else if(line == 4){
-		port = COM_PORT_4;
-	}else{
+	if(line < 1 || line > 4){
+		return false;
+	}
+	com_state *com = &coms[line-1];
+	uint16_t port = com->port;
+	
+	// Make sure a UART is present.
+	outb(port + COM_REG_SCRATCH, 0x5A);
+	if(inb(port + COM_REG_SCRATCH) != 0x5A){
 		return false;
 	}
 	
-	is_open[line-1] = true;
+	uint32_t flags = int_save();
+	com->open = false;
+	ring_init(&com->rx, com_rx_data[line-1], COM_BUFFER_SIZE, 1);
+	ring_init(&com->tx, com_tx_data[line-1], COM_BUFFER_SIZE, 1);
+	com->overruns = 0;
+	com->ier = COM_IER_RX | COM_IER_LINE;
+	com->fcr = COM_FCR_ENABLE | COM_TRIGGER_8;
 	
-	outb(port + 1, 0);           // Disable interrupts.
-	outb(port + 3, COM_DLAB);    // Enable DLAB in order to set baud rate.
-	outb(port + 0, divlo);       // Set baud rate.
-	outb(port + 1, divhi);
-	outb(port + 3, data | stop | parity);    // Bit settings.
-	outb(port + 1, COM_INTERRUPT_ENABLE);    // Enable interrupts
+	outb(port + COM_REG_IER, 0);                        // Disable interrupts.
+	outb(port + COM_REG_LCR, COM_DLAB);                 // Enable DLAB in order to set baud rate.
+	outb(port + COM_REG_DATA, divlo);                   // Set baud rate.
+	outb(port + COM_REG_IER, divhi);
+	outb(port + COM_REG_LCR, data | stop | parity);     // Bit settings.
+	outb(port + COM_REG_FCR, com->fcr | COM_FCR_CLEAR); // Enable and clear FIFOs.
+	outb(port + COM_REG_MCR, COM_MCR_READY);
+	com->open = true;
+	com_receive(com);                                   // Discard anything stale.
+	ring_clear(&com->rx);
+	outb(port + COM_REG_IER, com->ier);                 // Enable interrupts.
+	int_restore(flags);
 	return true;
 }
 
+/**
+ * Sets the receive FIFO trigger level of an open COM port.
+ * Lower levels reduce latency, higher levels reduce interrupts.
+ * @param line The COM port number (1-4).
+ * @param trigger The trigger level.
+ * @return Error code, or EOK if successful.
+ */
+int com_set_trigger(uint8_t line, com_trigger trigger){
+	com_state *com = com_get(line);
+	if(com == NULL){
+		return EBADF;
+	}
+	com->fcr = COM_FCR_ENABLE | trigger;
+	outb(com->port + COM_REG_FCR, com->fcr);
+	return EOK;
+}
+
 /**
  * Closes an open COM port.
  * @param line The COM port number (1-4).
  * @return Error code, or EOK is successful.
  */
 int com_close(uint8_t line){
-	// Determine the IO port.
-	uint16_t port = 0;
-	if(line == 1){
-		port = COM_PORT_1;
-	}else if(line == 2){
-		port = COM_PORT_2;
-	}else if(line == 3){
-		port = COM_PORT_3;
-	}else if(line == 4){
-		port = COM_PORT_4;
-	}else{
+	if(line < 1 || line > 4){
 		return EDOM;
 	}
+	com_state *com = &coms[line-1];
 	
-	outb(port + 1, 0);    // Disable interrupts.
-	
-	if(is_open[line-1]){
-		is_open[line-1] = false;
-		clear_queue(&buffer_out[line-1]);
-		clear_queue(&buffer_in[line-1]);
+	if(com->open){
+		com_flush(line);
 	}
+	uint32_t flags = int_save();
+	outb(com->port + COM_REG_IER, 0);    // Disable interrupts.
+	outb(com->port + COM_REG_MCR, 0);
+	com->open = false;
+	com->ier = 0;
+	int_restore(flags);
 	
 	return EOK;
 }
@@ -157,13 +296,15 @@ int com_close(uint8_t line){
 /**
  * Reads a character from a COM port.
  * @param line The COM port number (1-4).
- * @return The character read.
+ * @return The character read, or 0 if none is waiting.
  */
 char com_read(uint8_t line){
-	if(line >= 1 && line <= 4 && is_open[line-1]){
-		return (char)dequeue(&buffer_in[line-1]);
+	uint8_t ch = 0;
+	com_state *com = com_get(line);
+	if(com != NULL){
+		ring_pop(&com->rx, &ch);
 	}
-	return 0;
+	return (char)ch;
 }
 
 /**
@@ -173,10 +314,143 @@ char com_read(uint8_t line){
  * @return true if the character was written.
  */
 bool com_write(uint8_t line, char ch){
-	if(line >= 1 && line <= 4 && is_open[line-1]){
-		enqueue(&buffer_out[line-1], ch);
-		return true;
+	return com_writebuf(line, &ch, 1) == 1;
+}
+
+
+/**
+ * Reads the characters waiting on a COM port.
+ * @param line The COM port number (1-4).
+ * @param buf Buffer to read into.
+ * @param count Maximum number of characters to read.
+ * @return Number of characters read, or -1 with errno set.
+ */
+ssize_t com_readbuf(uint8_t line, void *buf, size_t count){
+	com_state *com = com_get(line);
+	if(com == NULL){
+		errno = EBADF;
+		return -1;
+	}
+	return ring_pop_bulk(&com->rx, buf, count);
+}
+
+/**
+ * Writes a buffer to a COM port.
+ * Waits for room in the transmit buffer if it is full.
+ * @param line The COM port number (1-4).
+ * @param buf Buffer to write.
+ * @param count Number of characters to write.
+ * @return Number of characters written, or -1 with errno set.
+ */
+ssize_t com_writebuf(uint8_t line, const void *buf, size_t count){
+	com_state *com = com_get(line);
+	if(com == NULL){
+		errno = EBADF;
+		return -1;
+	}
+	const uint8_t *str = buf;
+	size_t i = 0;
+	while(i < count){
+		// Writers in interrupt handlers would make a second producer.
+		uint32_t flags = int_save();
+		i += ring_push_bulk(&com->tx, &str[i], count - i);
+		// Start the transmitter, or make room by feeding it directly.
+		com_transmit(com);
+		int_restore(flags);
+	}
+	return count;
+}
+
+/**
+ * Writes a list of buffers to a COM port.
+ * @param line The COM port number (1-4).
+ * @param iov Buffers to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of characters written, or -1 with errno set.
+ */
+ssize_t com_writev(uint8_t line, const struct iovec *iov, int iovcnt){
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		ssize_t ret = com_writebuf(line, iov[i].iov_base, iov[i].iov_len);
+		if(ret < 0){
+			return ret;
+		}
+		total += ret;
+	}
+	return total;
+}
+
+/**
+ * Waits for everything written to a COM port to be sent.
+ * Works with interrupts disabled.
+ * @param line The COM port number (1-4).
+ * @return Error code, or EOK if successful.
+ */
+int com_flush(uint8_t line){
+	com_state *com = com_get(line);
+	if(com == NULL){
+		return EBADF;
+	}
+	bool idle = false;
+	while(!idle){
+		uint32_t flags = int_save();
+		com_transmit(com);
+		idle = !ring_count(&com->tx) && (inb(com->port + COM_REG_LSR) & COM_LSR_TEMT);
+		int_restore(flags);
 	}
-	return false;
+	return EOK;
+}
+
+/**
+ * Defines the device functions for one COM port.
+ * @param N The COM port number (1-4).
+ */
+#define COM_DEVICE(N) \
+	static char com##N##_sread(){ \
+		return com_read(N); \
+	} \
+	static int com##N##_swrite(char ch){ \
+		return com_write(N, ch) ? EOK : EBADF; \
+	} \
+	static int com##N##_flush(){ \
+		return com_flush(N); \
+	} \
+	static ssize_t com##N##_readbuf(unsigned int addr, void *buf, size_t count){ \
+		(void)addr; \
+		return com_readbuf(N, buf, count); \
+	} \
+	static ssize_t com##N##_writebuf(unsigned int addr, const void *buf, size_t count){ \
+		(void)addr; \
+		return com_writebuf(N, buf, count); \
+	} \
+	static ssize_t com##N##_writev(unsigned int addr, const struct iovec *iov, int iovcnt){ \
+		(void)addr; \
+		return com_writev(N, iov, iovcnt); \
+	}
+
+COM_DEVICE(1)
+COM_DEVICE(2)
+COM_DEVICE(3)
+COM_DEVICE(4)
+
+/**
+ * Builds the device descriptor for one COM port.
+ * @param N The COM port number (1-4).
+ */
+#define COM_DESCRIPTOR(N) { \
+	"COM" #N, \
+	DEVICE_FLAG_INOUT | DEVICE_FLAG_STREAM | DEVICE_FLAG_PHYSICAL, \
+	0, 0, \
+	0, 0, \
+	0, 0, \
+	com##N##_sread, com##N##_swrite, com##N##_flush, \
+	com##N##_readbuf, com##N##_writebuf, com##N##_writev \
 }
 
+//! COM port device descriptors, COM1 first.
+device_descriptor com_desc[4] = {
+	COM_DESCRIPTOR(1),
+	COM_DESCRIPTOR(2),
+	COM_DESCRIPTOR(3),
+	COM_DESCRIPTOR(4)
+};
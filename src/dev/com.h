@@ -9,8 +9,11 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "hal/device.h"
 
-const uint32_t COM_BAUD_MAX = 115200u;
+#define COM_BAUD_MAX 115200u    //!< Fastest baud rate, the UART clock divided by 16.
+
+//! Parity modes.
 typedef enum {
 	COM_PARITY_NONE  = 0x00,
 	COM_PARITY_ODD   = 0x08,
@@ -19,6 +22,17 @@ typedef enum {
 	COM_PARITY_SPACE = 0x38
 } com_parity;
 
+//! Number of bytes in the receive FIFO that raise an interrupt.
+typedef enum {
+	COM_TRIGGER_1  = 0x00,
+	COM_TRIGGER_4  = 0x40,
+	COM_TRIGGER_8  = 0x80,
+	COM_TRIGGER_14 = 0xC0
+} com_trigger;
+
+//! COM port device descriptors, COM1 first.
+device_descriptor com_desc[4];
+
 /**
  * Initial setup of COM devices.
  */
@@ -35,6 +49,15 @@ void com_init();
  */
 bool com_open(uint8_t line, uint32_t baud, uint8_t data, uint8_t stop, com_parity parity);
 
+/**
+ * Sets the receive FIFO trigger level of an open COM port.
+ * Lower levels reduce latency, higher levels reduce interrupts.
+ * @param line The COM port number (1-4).
+ * @param trigger The trigger level.
+ * @return Error code, or EOK if successful.
+ */
+int com_set_trigger(uint8_t line, com_trigger trigger);
+
 /**
  * Closes an open COM port.
  * @param line The COM port number (1-4).
@@ -45,7 +68,7 @@ int com_close(uint8_t line);
 /**
  * Reads a character from a COM port.
  * @param line The COM port number (1-4).
- * @return The character read.
+ * @return The character read, or 0 if none is waiting.
  */
 char com_read(uint8_t line);
 
@@ -57,5 +80,41 @@ char com_read(uint8_t line);
  */
 bool com_write(uint8_t line, char ch);
 
+/**
+ * Reads the characters waiting on a COM port.
+ * @param line The COM port number (1-4).
+ * @param buf Buffer to read into.
+ * @param count Maximum number of characters to read.
+ * @return Number of characters read, or -1 with errno set.
+ */
+ssize_t com_readbuf(uint8_t line, void *buf, size_t count);
+
+/**
+ * Writes a buffer to a COM port.
+ * Waits for room in the transmit buffer if it is full.
+ * @param line The COM port number (1-4).
+ * @param buf Buffer to write.
+ * @param count Number of characters to write.
+ * @return Number of characters written, or -1 with errno set.
+ */
+ssize_t com_writebuf(uint8_t line, const void *buf, size_t count);
+
+/**
+ * Writes a list of buffers to a COM port.
+ * @param line The COM port number (1-4).
+ * @param iov Buffers to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of characters written, or -1 with errno set.
+ */
+ssize_t com_writev(uint8_t line, const struct iovec *iov, int iovcnt);
+
+/**
+ * Waits for everything written to a COM port to be sent.
+ * Works with interrupts disabled.
+ * @param line The COM port number (1-4).
+ * @return Error code, or EOK if successful.
+ */
+int com_flush(uint8_t line);
+
 #endif
 
@@ -7,15 +7,22 @@
 #include "keyboard.h"
 
 #include <kernel/ioport.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
-#include <queue.h>
+#include <ring.h>
+#include <kernel/int.h>
 #include "sys/interrupt/isr.h"
+#include "sys/thread.h"
+#include "sys/timer.h"
 
 const uint8_t KEYBOARD_DATA_PORT   = 0x60;
 const uint8_t KEYBOARD_STATUS_PORT = 0x64;
 const uint8_t KEYBOARD_SETLED_COM  = 0xED;    //!< Command to set LED state.
-const uint8_t KEYBOARD_CLEAR_FLAG  = 0x02;    //!< Status port flag for ready state.
+const uint8_t KEYBOARD_BUSY_FLAG   = 0x02;    //!< Status port flag set while the controller input is full.
+enum { KEYBOARD_WAIT_MS = 10 };      //!< Longest wait for the controller.
 enum { KEYBOARD_UP_FLAG = 0x80 };    //!< Flag in scancodes for key up.
+enum { KEYBOARD_EXTENDED = 0xE0 };   //!< Prefix for extended scancodes.
 
 //! Map of scan codes to characters.
 static unsigned char keyboard_map[] = {
@@ -41,11 +48,36 @@ static unsigned char keyboard_map_shift[] = {
 	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F                  // 70 - 7F
 };
 
+//! Map of extended scan codes to keys, indexed from 0x47.
+static unsigned char keyboard_map_extended[] = {
+	KEY_HOME, KEY_UP, KEY_PGUP, 0, KEY_LEFT, 0, KEY_RIGHT, 0, KEY_END,    // 47 - 4F
+	KEY_DOWN, KEY_PGDOWN, KEY_INSERT, KEY_DELETE                         // 50 - 53
+};
+
 static uint8_t mod_state = 0;    //!< State of modifier keys.
 static uint8_t led_state = 0;    //!< State of keyboards LEDs.
 
-static queue buffer;
-static int buff_data[KEY_BUFFER_SIZE];
+static ring buffer;                             //!< Key strokes, filled by the ISR.
+static uint16_t buff_data[KEY_BUFFER_SIZE];     //!< Storage for the key stroke ring.
+static bool extended = false;          //!< Last scancode was the extended prefix.
+static keyboard_hook key_hook = NULL;  //!< Function called for each key stroke.
+static thread_queue key_waiters;       //!< Threads waiting for a key stroke.
+
+/**
+ * Waits for the controller to accept a byte.
+ * Sleeps between polls rather than spinning, the controller can take a few
+ * milliseconds.
+ * @return true if the controller is ready, false if it timed out.
+ */
+static bool keyboard_wait_ready(){
+	for(int i = 0; i < KEYBOARD_WAIT_MS; ++i){
+		if(!(inb(KEYBOARD_STATUS_PORT) & KEYBOARD_BUSY_FLAG)){
+			return true;
+		}
+		ksleep(1);
+	}
+	return !(inb(KEYBOARD_STATUS_PORT) & KEYBOARD_BUSY_FLAG);
+}
 
 /**
  * Set the keyboard LED state.
@@ -53,10 +85,14 @@ static int buff_data[KEY_BUFFER_SIZE];
  */
 void keyboard_set_led(uint8_t status){
 	led_state = status;
-	while(!(inb(KEYBOARD_STATUS_PORT) & KEYBOARD_CLEAR_FLAG)){}
+	if(!keyboard_wait_ready()){
+		return;
+	}
 	outb(KEYBOARD_DATA_PORT, KEYBOARD_SETLED_COM);
 
-	while(!(inb(KEYBOARD_STATUS_PORT) & KEYBOARD_CLEAR_FLAG)){}
+	if(!keyboard_wait_ready()){
+		return;
+	}
 	outb(KEYBOARD_DATA_PORT, status);
 }
 
@@ -72,7 +108,7 @@ uint8_t keyboard_get_led(){
  * Clears the keyboard input buffer.
  */
 void keyboard_clear_buffer(){
-	clear_queue(&buffer);
+	ring_clear(&buffer);
 }
 
 /**
@@ -80,7 +116,25 @@ void keyboard_clear_buffer(){
  * @return The key stroke, lower 8 bits are the character, upper 8 bits are modifier flags.
  */
 uint16_t keyboard_get_key(){
-	return (uint16_t)dequeue(&buffer);
+	uint16_t key = 0;
+	ring_pop(&buffer, &key);
+	return key;
+}
+
+/**
+ * Waits for a key stroke.
+ * The calling thread blocks until a key is pressed, unless interrupts are
+ * disabled.
+ * @return The key stroke, or 0 if there is none and interrupts are disabled.
+ */
+uint16_t keyboard_wait_key(){
+	uint32_t flags = int_save();
+	uint16_t key;
+	while(!(key = keyboard_get_key()) && (flags & 0x200)){
+		thread_wait(&key_waiters);
+	}
+	int_restore(flags);
+	return key;
 }
 
 /**
@@ -93,7 +147,20 @@ static void keyboard_isr(isr_regs regs){
 	unsigned char new_char = 0;
 	unsigned char scan_code = inb(KEYBOARD_DATA_PORT);
 
+	if(scan_code == KEYBOARD_EXTENDED){
+		extended = true;
+		return;
+	}
+	if(extended){
+		extended = false;
+		if(scan_code >= 0x47 && scan_code <= 0x53){
+			new_char = keyboard_map_extended[scan_code - 0x47];
+		}
+		scan_code = 0;
+	}
+
 	switch(scan_code){
+		case 0: break;
 		case 0x2A:    // Left Shift Down
 			mod_state = mod_state | KEY_LSHIFT_MASK;
 		break;
@@ -136,15 +203,27 @@ static void keyboard_isr(isr_regs regs){
 	}
 
 	if(new_char){
-		enqueue(&buffer, (((uint16_t)mod_state << 8) | new_char));
+		uint16_t key = ((uint16_t)mod_state << 8) | new_char;
+		if(!key_hook || !key_hook(key)){
+			ring_push(&buffer, &key);
+			thread_wake_all(&key_waiters);
+		}
 	}
 }
 
+/**
+ * Sets the function to call for each key stroke before it is buffered.
+ * @param hook The function to call, or NULL for none.
+ */
+void keyboard_set_hook(keyboard_hook hook){
+	key_hook = hook;
+}
+
 /**
  * Initializes the keyboard input driver.
  */
 void keyboard_init(){
-	new_queue(&buffer, (int*)&buff_data, KEY_BUFFER_SIZE);
+	ring_init(&buffer, buff_data, KEY_BUFFER_SIZE, sizeof(buff_data[0]));
 	isr_register(IRQ1, &keyboard_isr);
 }
 
@@ -7,9 +7,10 @@
 #ifndef __DEV_KEYBOARD_H_
 #define __DEV_KEYBOARD_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
-#define KEY_BUFFER_SIZE 128
+#define KEY_BUFFER_SIZE 128    //!< Key strokes buffered, must be a power of two.
 
 #define KEY_LSHIFT_MASK 0x80    // 1000 0000
 #define KEY_RSHIFT_MASK 0x08    // 0000 1000
@@ -86,6 +87,13 @@ enum {
 	KEY_BREAK = 0xFF
 };
 
+/**
+ * Function called from the keyboard interrupt for each key stroke.
+ * @param key The key stroke, lower 8 bits are the character, upper 8 bits are modifier flags.
+ * @return true if the key stroke was consumed and should not be buffered.
+ */
+typedef bool (*keyboard_hook)(uint16_t key);
+
 /**
  * Set the keyboard LED state.
  * @param status LED status flags.
@@ -109,6 +117,20 @@ void keyboard_clear_buffer();
  */
 uint16_t keyboard_get_key();
 
+/**
+ * Waits for a key stroke.
+ * The calling thread blocks until a key is pressed, unless interrupts are
+ * disabled.
+ * @return The key stroke, or 0 if there is none and interrupts are disabled.
+ */
+uint16_t keyboard_wait_key();
+
+/**
+ * Sets the function to call for each key stroke before it is buffered.
+ * @param hook The function to call, or NULL for none.
+ */
+void keyboard_set_hook(keyboard_hook hook);
+
 /**
  * Initializes the keyboard input driver.
  */
@@ -0,0 +1,71 @@
+/**
+ * @file dev/madt.h
+ * Multiple APIC Description Table data structure.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_MADT_H_
+#define __INCLUDE_MADT_H_
+
+#include <stdint.h>
+#include "sdt.h"
+
+#define MADT_FLAG_PCAT_COMPAT 0x01    //!< Legacy 8259 PICs are also installed.
+
+/**
+ * Types of MADT entries.
+ */
+enum madt_type {
+	MADT_LAPIC          = 0,    //!< Processor local APIC.
+	MADT_IOAPIC         = 1,    //!< I/O APIC.
+	MADT_OVERRIDE       = 2,    //!< Interrupt source override.
+	MADT_NMI_SOURCE     = 3,    //!< Non-maskable interrupt source.
+	MADT_LAPIC_NMI      = 4,    //!< Local APIC NMI pin.
+	MADT_LAPIC_OVERRIDE = 5     //!< 64bit local APIC address.
+};
+
+struct madt{
+	struct sdt_header header;
+	uint32_t lapic_addr;    //!< Physical address of the local APICs.
+	uint32_t flags;         //!< Any of MADT_FLAG_*.
+	uint8_t entries[];      //!< Variable length entries.
+} __attribute__((packed));
+
+//! Header shared by all MADT entries.
+struct madt_entry{
+	uint8_t type;      //!< One of madt_type.
+	uint8_t length;    //!< Length of the entry including this header.
+} __attribute__((packed));
+
+struct madt_lapic{
+	struct madt_entry header;
+	uint8_t acpi_id;    //!< ACPI processor ID.
+	uint8_t apic_id;    //!< Local APIC ID.
+	uint32_t flags;     //!< Bit 0 set if the processor is enabled.
+} __attribute__((packed));
+
+struct madt_ioapic{
+	struct madt_entry header;
+	uint8_t id;            //!< I/O APIC ID.
+	uint8_t _reserved;     //!< Ignored.
+	uint32_t addr;         //!< Physical address of the I/O APIC.
+	uint32_t gsi_base;     //!< First global system interrupt it handles.
+} __attribute__((packed));
+
+struct madt_override{
+	struct madt_entry header;
+	uint8_t bus;        //!< Always 0, ISA.
+	uint8_t source;     //!< ISA IRQ number.
+	uint32_t gsi;       //!< Global system interrupt it is wired to.
+	uint16_t flags;     //!< Polarity in bits 0-1, trigger mode in bits 2-3.
+} __attribute__((packed));
+
+struct madt_lapic_override{
+	struct madt_entry header;
+	uint16_t _reserved;    //!< Ignored.
+	uint64_t addr;         //!< Physical address of the local APICs.
+} __attribute__((packed));
+
+static char const *const madt_sig = "APIC";
+
+#endif /* __INCLUDE_MADT_H_ */
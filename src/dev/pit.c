@@ -6,6 +6,7 @@
 
 #include "pit.h"
 
+#include <errno.h>
 #include <kernel/ioport.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -13,6 +14,9 @@
 
 #define PIT_CH0_IRQ (IRQ0)
 #define PIT_BEEP_ENABLE (0x03)
+#define PIT_CH2_GATE    (0x01)    //!< Channel 2 counts while set.
+#define PIT_CH2_OUT     (0x20)    //!< Channel 2 output, set at terminal count in mode 0.
+#define PIT_DELAY_MAX   (54925)   //!< Longest delay in microseconds, 65535 PIT clocks.
 
 enum {
 	PIT_CH0_PORT = 0x40,    //!< PIT channel 0 data port.
@@ -24,11 +28,16 @@ enum {
 	PIT_FLAG_CH0   = 0x00,    //!< Select channel 0.
 	PIT_FLAG_CH2   = 0x80,    //!< Select channel 2.
 	PIT_FLAG_HILO  = 0x30,    //!< Use high/low access mode.
+	PIT_FLAG_MODE0 = 0x00,    //!< Interrupt on terminal count.
 	PIT_FLAG_MODE2 = 0x04,    //!< Rate generator.
 	PIT_FLAG_MODE3 = 0x06,    //!< Square wave generator.
 	PIT_FLAG_BIN   = 0x00     //!< 16bit binary mode.
 };
 
+enum {
+	PIT_HOOKS = 4    //!< Maximum number of periodic hooks.
+};
+
 const float PIT_CLOCK_FREQ = 1193180;
 
 /**
@@ -38,6 +47,15 @@ static uint32_t ch0_freq = 0;
 static float resolution = 0;
 static uint64_t tick = 0;
 
+/**
+ * Periodic function called from the timer interrupt.
+ */
+static struct {
+	pit_hook hook;         //!< Function to call.
+	uint32_t period;       //!< Ticks between calls.
+	uint32_t remaining;    //!< Ticks until the next call.
+} hooks[PIT_HOOKS];
+
 /**
  * Callback function for interrupt from PIT Channel 0.
  * @param regs Register struct from common ISR.
@@ -46,6 +64,12 @@ static void pit_callback(isr_regs regs){
 	(void)regs;
 	
 	++tick;
+	for(int i = 0; i < PIT_HOOKS && hooks[i].hook; ++i){
+		if(--hooks[i].remaining == 0){
+			hooks[i].remaining = hooks[i].period;
+			hooks[i].hook();
+		}
+	}
 }
 
 
@@ -78,6 +102,31 @@ void pit_nosound(){
 	outb(PIT_BEEP_REG, inb(PIT_BEEP_REG) & ~PIT_BEEP_ENABLE);
 }
 
+/**
+ * Busy waits using PIT Channel 2, without interrupts.
+ * The PC speaker is disconnected while waiting.
+ * @param usec Microseconds to wait, at most 54925.
+ */
+void pit_delay(uint32_t usec){
+	if(usec > PIT_DELAY_MAX){
+		usec = PIT_DELAY_MAX;
+	}
+	uint32_t count = (usec * 1193u) / 1000u;
+	if(count == 0){
+		count = 1;
+	}
+	
+	// Gate channel 2 on with the speaker off, counting starts once the count is loaded.
+	outb(PIT_BEEP_REG, (inb(PIT_BEEP_REG) & ~PIT_BEEP_ENABLE) | PIT_CH2_GATE);
+	outb(PIT_MODE_REG, (PIT_FLAG_CH2 | PIT_FLAG_HILO | PIT_FLAG_MODE0 | PIT_FLAG_BIN));
+	outb(PIT_CH2_PORT, count & 0xFF);
+	outb(PIT_CH2_PORT, (count >> 8) & 0xFF);
+	while(!(inb(PIT_BEEP_REG) & PIT_CH2_OUT)){
+		// Wait for terminal count.
+	}
+	outb(PIT_BEEP_REG, inb(PIT_BEEP_REG) & ~PIT_CH2_GATE);
+}
+
 /**
  * Initialize the PIT Channel 0 timer.
  * @param frequency The frequency of interrupts to generate (19 - 1193180Hz).
@@ -104,3 +153,40 @@ void pit_init(uint32_t frequency){
 	outb(PIT_CH0_PORT, hi);
 }
 
+
+/**
+ * Returns the number of PIT Channel 0 interrupts since pit_init().
+ * @return The tick count.
+ */
+uint64_t pit_ticks(){
+	return tick;
+}
+
+/**
+ * Returns the frequency of PIT Channel 0 interrupts.
+ * @return The frequency in Hz, or zero if the timer is not running.
+ */
+uint32_t pit_frequency(){
+	return ch0_freq;
+}
+
+/**
+ * Registers a function to call periodically from the timer interrupt.
+ * @param hook Function to call.
+ * @param period Number of ticks between calls.
+ * @return Error code, or EOK if successful.
+ */
+int pit_add_hook(pit_hook hook, uint32_t period){
+	if(!hook || !period){
+		return EINVAL;
+	}
+	for(int i = 0; i < PIT_HOOKS; ++i){
+		if(!hooks[i].hook){
+			hooks[i].period = period;
+			hooks[i].remaining = period;
+			hooks[i].hook = hook;
+			return EOK;
+		}
+	}
+	return ENOMEM;
+}
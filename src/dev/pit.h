@@ -9,6 +9,11 @@
 
 #include <stdint.h>
 
+/**
+ * Function called periodically from the PIT Channel 0 interrupt.
+ */
+typedef void (*pit_hook)();
+
 /**
  * Plays a tone over the PC speaker.
  * @param frequency The frequency of the tone.
@@ -20,11 +25,38 @@ void pit_tone(uint32_t frequency);
  */
 void pit_nosound();
 
+/**
+ * Busy waits using PIT Channel 2, without interrupts.
+ * The PC speaker is disconnected while waiting.
+ * @param usec Microseconds to wait, at most 54925.
+ */
+void pit_delay(uint32_t usec);
+
 /**
  * Initialize the PIT Channel 0 timer.
  * @param frequency The frequency of interrupts to generate (19 - 1193180Hz).
  */
 void pit_init(uint32_t frequency);
 
+/**
+ * Returns the number of PIT Channel 0 interrupts since pit_init().
+ * @return The tick count.
+ */
+uint64_t pit_ticks();
+
+/**
+ * Returns the frequency of PIT Channel 0 interrupts.
+ * @return The frequency in Hz, or zero if the timer is not running.
+ */
+uint32_t pit_frequency();
+
+/**
+ * Registers a function to call periodically from the timer interrupt.
+ * @param hook Function to call.
+ * @param period Number of ticks between calls.
+ * @return Error code, or EOK if successful.
+ */
+int pit_add_hook(pit_hook hook, uint32_t period);
+
 #endif /* __DEV_PT_H_ */ 
 
@@ -46,6 +46,9 @@ uint32_t ram_mmap_length(){
 void ram_dump(uint8_t *addr){
 	addr = (uint8_t*)((uint32_t)addr & 0xFFFFFFF0);
 	uint8_t *end = addr + 256;
+	// Write the whole dump at once.
+	int mode = stdout->mode;
+	setvbuf(stdout, NULL, _IOFBF, 0);
 	for(; addr < end; addr+=16){
 		printf("\e[1;37;44m 0x%08X  ", (uint32_t)addr);
 		for(int i = 0; i < 16; ++i){
@@ -61,6 +64,7 @@ void ram_dump(uint8_t *addr){
 		}
 		puts("\e[0m\n");
 	}
+	setvbuf(stdout, NULL, mode, 0);
 }
 
 /**
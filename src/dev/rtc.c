@@ -6,9 +6,12 @@
 
 #include "rtc.h"
 
+#include <kernel/div.h>
 #include <kernel/ioport.h>
 #include <stdint.h>
-#include "sys/interrupt/isr.h"
+#include "hal/console.h"
+#include "sys/clock.h"
+#include "sys/timer.h"
 #include <stdio.h>
 
 enum {
@@ -36,9 +39,7 @@ enum {
 
 #define RTC_YEAR_BASE     (2000)
 
-#define RTC_IRQ (IRQ8)
-
-#define RTC_IRQ_FREQ (1024)
+static timer status_timer;    //!< Redraws the status bar each minute.
 
 /**
  * Converts a BCD number to a standard integer.
@@ -135,43 +136,26 @@ struct tm *rtc_time(struct tm *dt){
 }
 
 /**
- * Real-time clock interrupt handler.
- * @param regs Register struct from common ISR.
+ * Draws the date and time in the status bar, then waits for the next minute.
+ * The time comes from the clock, the CMOS is not read.
+ * @param t The status bar timer.
  */
-static void rtc_isr(isr_regs regs){
-	static uint64_t count = 0;
-	(void)regs;
-	
-	++count;
-	
-	if(count == RTC_IRQ_FREQ){
-		static uint8_t prev_min = 255;
-		struct tm dt;
-		rtc_time(&dt);
-		if(dt.tm_sec == 0 && prev_min != dt.tm_min){
-			printf("\e[s\e[0;0H\e[K\e[7m%04d-%02d-%02d %02d:%02d\e[27m\e[u", dt.tm_year+1900, dt.tm_mon+1, dt.tm_mday, dt.tm_hour, dt.tm_min);
-		}
-		count = 0;
-		prev_min = dt.tm_min;
-	}
-	
-	// Reset interrupt
-	outb(RTC_REG_ADDRESS, RTC_REG_STATC);
-	(void)inb(RTC_REG_DATA);
+static void rtc_status(timer *t){
+	uint64_t now = clock_realtime_ns();
+	uint32_t nsec = div64_32(&now, CLOCK_NS_PER_SEC);
+	time_t secs = now;
+	struct tm dt;
+	gmtime_r(&secs, &dt);
+	// Straight to the console, stdout may hold part of a line.
+	devprintf(&console_desc, "\e[s\e[0;0H\e[K\e[7m%04d-%02d-%02d %02d:%02d\e[27m\e[u", dt.tm_year+1900, dt.tm_mon+1, dt.tm_mday, dt.tm_hour, dt.tm_min);
+	timer_add(t, (60 - dt.tm_sec)*1000 - nsec/1000000);
 }
 
 /**
- * Initializes the CMOS real-time clock.
+ * Starts showing the date and time in the status bar.
+ * Must be called after clock_init().
  */
 void rtc_init(){
-	// Register the timer callback
-	isr_register(RTC_IRQ, &rtc_isr);
-	
-	// Read the current value of register B
-	outb(RTC_REG_ADDRESS, RTC_REG_STATB);
-	uint8_t prev = inb(RTC_REG_DATA);
-	// Enable the IRQ
-	outb(RTC_REG_ADDRESS, RTC_REG_STATB);
-	outb(RTC_REG_DATA, prev | RTC_FLAG_IRQ);
+	status_timer.handler = &rtc_status;
+	timer_add(&status_timer, 0);
 }
-
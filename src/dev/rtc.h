@@ -18,7 +18,8 @@
 struct tm *rtc_time(struct tm *);
 
 /**
- * Initializes the CMOS real-time clock.
+ * Starts showing the date and time in the status bar.
+ * Must be called after clock_init().
  */
 void rtc_init();
 
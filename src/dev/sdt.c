@@ -61,6 +61,7 @@ device_descriptor sdt_desc = {
 	0, 0,
 	0, 0,
 	sdt_read, 0,
+	0, 0, 0,
 	0, 0, 0
 };
 
@@ -9,15 +9,18 @@
 #include <errno.h>
 #include <kernel/ioport.h>
 #include <stdint.h>
+#include <string.h>
 #include "bda.h"
 
 enum {
 	MIN_ADDR = 0x00000000u,   //!< Minimum supported address.
-	MAX_ADDR = 0x000007D1u    //!< Maximum supported address.  (80*25) + 1    (1 for special addresses).
+	MAX_ADDR = 0x00004001u    //!< Maximum supported address.  32KiB of cells + 2 special addresses.
 };
 enum {
 	CURSOR_LO_COMMAND = 0x0F,   //!< Command to write low byte to I/O port
-	CURSOR_HI_COMMAND = 0x0E    //!< Command to write high byte to I/O port
+	CURSOR_HI_COMMAND = 0x0E,   //!< Command to write high byte to I/O port
+	START_LO_COMMAND  = 0x0D,   //!< Command to write start address low byte to I/O port
+	START_HI_COMMAND  = 0x0C    //!< Command to write start address high byte to I/O port
 };
 
 static volatile struct {
@@ -28,7 +31,7 @@ static volatile struct {
 			uint8_t fg:4;
 			uint8_t bg:4;
 		};
-	} character[2000];
+	} character[VGA_CELLS];
 } *videoram = (void*)0xB8000;    //!< Video output buffer.
 
 static uint16_t ioport = 0;    //!< Video IOport base address from BDA.
@@ -40,7 +43,8 @@ device_descriptor vga_desc = {
 	MIN_ADDR, MAX_ADDR,
 	0, 0,
 	vga_read, vga_write,
-	0, 0, 0
+	0, 0, 0,
+	vga_readbuf, vga_writebuf, vga_writev
 };
 
 /**
@@ -48,7 +52,7 @@ device_descriptor vga_desc = {
  */
 void vga_init(){
 	ioport = bda_desc.bread(BDA_VIDEO_IOPORT);
-	for(unsigned int i = MIN_ADDR; i <= MAX_ADDR; ++i){
+	for(unsigned int i = MIN_ADDR; i < VGA_CELLS; ++i){
 		videoram->character[i].bg = 0x0;
 		videoram->character[i].fg = 0xF;
 		videoram->character[i].asc = ' ';
@@ -61,9 +65,9 @@ void vga_init(){
  * @return The value read.
  */
 int vga_read(unsigned int addr){
-	if(addr == VGA_ADDR_CURSOR){
+	if(addr == VGA_ADDR_CURSOR || addr == VGA_ADDR_START){
 		return 0;
-	}else if(addr <= MAX_ADDR){
+	}else if(addr < VGA_CELLS){
 		vga_desc.read_count += 2;
 		return videoram->character[addr].cell;
 	}
@@ -82,12 +86,22 @@ int vga_write(unsigned int addr, int value){
 			vga_init();
 		}
 		// Write cursor low byte.
-		outb(ioport, 0x0F);
+		outb(ioport, CURSOR_LO_COMMAND);
 		outb(ioport+1, (uint8_t)((uint16_t)value & 0xFF));
 		// Write cursor high byte.
-		outb(ioport, 0x0E);
+		outb(ioport, CURSOR_HI_COMMAND);
+		outb(ioport+1, (uint8_t)((((uint16_t)value) >> 8) & 0xFF));
+	}else if(addr == VGA_ADDR_START){
+		if(!ioport){
+			vga_init();
+		}
+		// Write start address high byte.
+		outb(ioport, START_HI_COMMAND);
 		outb(ioport+1, (uint8_t)((((uint16_t)value) >> 8) & 0xFF));
-	}else if(addr <= MAX_ADDR){
+		// Write start address low byte.
+		outb(ioport, START_LO_COMMAND);
+		outb(ioport+1, (uint8_t)((uint16_t)value & 0xFF));
+	}else if(addr < VGA_CELLS){
 		videoram->character[addr].cell = value;
 	}else{
 		return EDOM;
@@ -96,3 +110,82 @@ int vga_write(unsigned int addr, int value){
 	return EOK;
 }
 
+
+/**
+ * Reads a buffer of cells from the video output.
+ * @param addr Address of the first cell.
+ * @param buf Buffer to read into.
+ * @param count Number of bytes to read, two per cell.
+ * @return Number of bytes read, or -1 with errno set.
+ */
+ssize_t vga_readbuf(unsigned int addr, void *buf, size_t count){
+	if(addr >= VGA_CELLS){
+		errno = EDOM;
+		return -1;
+	}
+	if(count > (VGA_CELLS - addr)*sizeof(uint16_t)){
+		count = (VGA_CELLS - addr)*sizeof(uint16_t);
+	}
+	memcpy(buf, (uint16_t*)&videoram->character[addr], count);
+	vga_desc.read_count += count;
+	return count;
+}
+
+/**
+ * Writes a buffer of cells to the video output.
+ * @param addr Address of the first cell.
+ * @param buf Cells to write.
+ * @param count Number of bytes to write, two per cell.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t vga_writebuf(unsigned int addr, const void *buf, size_t count){
+	if(addr >= VGA_CELLS){
+		errno = EDOM;
+		return -1;
+	}
+	if(count > (VGA_CELLS - addr)*sizeof(uint16_t)){
+		count = (VGA_CELLS - addr)*sizeof(uint16_t);
+	}
+	memcpy((uint16_t*)&videoram->character[addr], buf, count);
+	vga_desc.write_count += count;
+	return count;
+}
+
+/**
+ * Writes a list of buffers of cells to the video output.
+ * Each buffer continues from the cell after the previous one.
+ * @param addr Address of the first cell.
+ * @param iov Cells to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t vga_writev(unsigned int addr, const struct iovec *iov, int iovcnt){
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		ssize_t ret = vga_writebuf(addr + total/sizeof(uint16_t), iov[i].iov_base, iov[i].iov_len);
+		if(ret < 0){
+			return total ? total : ret;
+		}
+		total += ret;
+		if((size_t)ret < iov[i].iov_len){
+			break;
+		}
+	}
+	return total;
+}
+
+/**
+ * Copies a run of text cells to the video output.
+ * @param addr Address of the first cell.
+ * @param cells Cells to copy.
+ * @param count Number of cells.
+ * @return Error code or EOK.
+ */
+int vga_copy(unsigned int addr, const uint16_t *cells, unsigned int count){
+	if(addr >= VGA_CELLS || count > VGA_CELLS - addr){
+		return EDOM;
+	}
+	memcpy((uint16_t*)&videoram->character[addr], cells, count*sizeof(uint16_t));
+	vga_desc.write_count += count*2;
+	return EOK;
+}
@@ -8,10 +8,13 @@
 #define __DEV_VGA_H_
 
 #include <errno.h>
+#include <stdint.h>
 
 #include "hal/device.h"
 
-#define VGA_ADDR_CURSOR 0x000007D1u    //!< Special address to set the cursor position.
+#define VGA_CELLS       0x00004000u    //!< Number of text cells in video memory.
+#define VGA_ADDR_CURSOR 0x00004000u    //!< Special address to set the cursor position.
+#define VGA_ADDR_START  0x00004001u    //!< Special address to set the first cell displayed.
 
 //! Video out device descriptor.
 device_descriptor vga_desc;
@@ -36,5 +39,42 @@ int vga_read(unsigned int);
  */
 int vga_write(unsigned int, int);
 
+/**
+ * Reads a buffer of cells from the video output.
+ * @param addr Address of the first cell.
+ * @param buf Buffer to read into.
+ * @param count Number of bytes to read, two per cell.
+ * @return Number of bytes read, or -1 with errno set.
+ */
+ssize_t vga_readbuf(unsigned int addr, void *buf, size_t count);
+
+/**
+ * Writes a buffer of cells to the video output.
+ * @param addr Address of the first cell.
+ * @param buf Cells to write.
+ * @param count Number of bytes to write, two per cell.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t vga_writebuf(unsigned int addr, const void *buf, size_t count);
+
+/**
+ * Writes a list of buffers of cells to the video output.
+ * Each buffer continues from the cell after the previous one.
+ * @param addr Address of the first cell.
+ * @param iov Cells to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t vga_writev(unsigned int addr, const struct iovec *iov, int iovcnt);
+
+/**
+ * Copies a run of text cells to the video output.
+ * @param addr Address of the first cell.
+ * @param cells Cells to copy.
+ * @param count Number of cells.
+ * @return Error code or EOK.
+ */
+int vga_copy(unsigned int addr, const uint16_t *cells, unsigned int count);
+
 #endif
 
@@ -1,26 +1,50 @@
 /**
  * @file hal/console.c
  * Console I/O device driver.
+ *
+ * Output is drawn into a shadow copy of the text screen in RAM.  Rows that
+ * change are marked dirty and copied to VRAM in runs on flush, when reading
+ * input, or from a clock event queued by the first write after a flush.  The
+ * hardware cursor is only reprogrammed when its position has changed since
+ * the last flush.
+ *
+ * The shadow is a ring of rows, scrolling moves the index of the top row and
+ * blanks the rows exposed at the bottom.  VRAM holds many more rows than the
+ * screen, so scrolling also moves the CRTC start address down and only the
+ * exposed rows are copied.  Once the start address reaches the end of VRAM
+ * the whole screen is copied back to the beginning.
+ *
+ * Rows scrolled off the top are appended to a history ring, which can be
+ * browsed with Shift+PgUp and Shift+PgDn.
+ *
+ * Everything written can also be mirrored to another device, such as a COM
+ * port, in the same sized chunks it was written in.
  * @author Conlan Wesson
  */
 
 #include "console.h"
 
-#include <stdio.h>
 #include <ctype.h>
+#include <kernel/int.h>
+#include <stdio.h>
+#include <string.h>
 #include "device.h"
 #include "dev/keyboard.h"
 #include "dev/vga.h"
+#include "sys/clock.h"
+#include "sys/frame.h"
 
 enum {
 	VROWS    = 25,
 	VROW_MAX = (VROWS-1),
 	VCOLS    = 80,
-	VCOL_MAX = (VCOLS-1)
+	VCOL_MAX = (VCOLS-1),
+	VRAM_ROWS = (VGA_CELLS/VCOLS)    //!< Number of whole rows in VRAM.
 };
 enum {
 	TAB_WIDTH  =   4,    //!< Number of spaces to print for tab character/
-	MAX_LENGTH = 255     //!< Maximum string length.
+	MAX_LENGTH = 255,    //!< Maximum string length.
+	FLUSH_RATE = 50      //!< Most shadow buffer flushes per second.
 };
 
 /**
@@ -90,6 +114,34 @@ static bool bright = false;
 //! Do not show output.
 static bool conceal = false;
 
+//! Shadow copy of the text screen.
+static uint16_t shadow[VROWS*VCOLS] = {[0 ... VROWS*VCOLS-1] = VBLANK};
+//! Shadow row shown at the top of the screen.
+static int8_t top = 0;
+//! Bitmap of screen rows changed since the last flush.
+static volatile uint32_t dirty = 0;
+//! VRAM row shown at the top of the screen.
+static int16_t vstart = 0;
+//! VRAM row last written to the CRTC start address.
+static int16_t hwstart = 0;
+//! Cursor position last written to the hardware.
+static int16_t hwcursor = 0;
+//! Event which flushes pending output.
+static clock_event flush_event;
+
+//! Ring of rows scrolled off the screen.
+static uint16_t *history = NULL;
+//! Number of rows the history can hold.
+static uint32_t history_size = 0;
+//! History row to write next.
+static uint32_t history_head = 0;
+//! Number of rows in the history.
+static uint32_t history_count = 0;
+//! Number of rows the view is scrolled back into the history.
+static uint32_t view = 0;
+//! Device receiving a copy of console output, or NULL.
+static device_descriptor *mirror = NULL;
+
 //! Enum to indicate the state of an escape code.
 enum escaped_level{
 	ESC_NONE = 0,    //!< No escape character has been read.
@@ -107,11 +159,200 @@ enum clear_amount{
 //! Current state of the output escape code.
 static enum escaped_level escaped = ESC_NONE;
 
+/**
+ * Finds a screen row in the shadow buffer.
+ * @param y The row coordinate.
+ * @return The first cell of the row.
+ */
+static inline uint16_t *console_row(int8_t y){
+	int row = top + y;
+	if(row >= VROWS){
+		row -= VROWS;
+	}
+	return &shadow[VPOS(0, row)];
+}
+
+/**
+ * Finds the row shown on the screen while scrolled back.
+ * @param y The row coordinate.
+ * @return The first cell of the row.
+ */
+static const uint16_t *console_view_row(int8_t y){
+	if((uint32_t)y >= view){
+		return console_row(y - view);
+	}
+	uint32_t row = history_head + history_size - (view - y);
+	if(row >= history_size){
+		row -= history_size;
+	}
+	return &history[row*VCOLS];
+}
+
+/**
+ * Copies dirty rows and the cursor position to the video output.
+ */
+static void console_sync(){
+	uint32_t flags = int_save();
+	uint32_t rows = dirty;
+	dirty = 0;
+	if(view && rows){
+		// Scrolled back, redraw the whole view.
+		for(int8_t y = 0; y < VROWS; ++y){
+			vga_copy((vstart + y)*VCOLS, console_view_row(y), VCOLS);
+		}
+		rows = 0;
+	}
+	while(rows){
+		// Copy each run of adjacent dirty rows at once, split where the ring wraps.
+		int first = __builtin_ctz(rows);
+		int count = __builtin_ctz(~(rows >> first));
+		rows &= ~(((1u << count) - 1) << first);
+		while(count){
+			int part = VROWS - ((top + first) % VROWS);
+			if(part > count){
+				part = count;
+			}
+			vga_copy((vstart + first)*VCOLS, console_row(first), part*VCOLS);
+			first += part;
+			count -= part;
+		}
+	}
+	if(vstart != hwstart){
+		// Rows are in place, show them.
+		vga_desc.bwrite(VGA_ADDR_START, vstart*VCOLS);
+		hwstart = vstart;
+	}
+	int16_t pos = (vstart + vrow + view)*VCOLS + vcol;
+	if(vrow + view > VROW_MAX){
+		// Hide the cursor below the screen.
+		pos = (vstart + VROWS)*VCOLS;
+	}
+	if(pos != hwcursor){
+		vga_desc.bwrite(VGA_ADDR_CURSOR, pos);
+		hwcursor = pos;
+	}
+	int_restore(flags);
+}
+
+/**
+ * Scrolls the view through the history.
+ * @param amount Number of rows to move back, negative to move forward.
+ */
+static void console_view(int32_t amount){
+	uint32_t flags = int_save();
+	if(amount < 0 && (uint32_t)-amount > view){
+		view = 0;
+	}else if(amount > 0 && (uint32_t)amount > history_count - view){
+		view = history_count;
+	}else{
+		view += amount;
+	}
+	dirty = (1u << VROWS) - 1;
+	int_restore(flags);
+}
+
+/**
+ * Handles history keys from the keyboard interrupt.
+ * @param key The key stroke.
+ * @return true if the key was used.
+ */
+static bool console_key(uint16_t key){
+	bool shift = (key >> 8) & (KEY_LSHIFT_MASK | KEY_RSHIFT_MASK);
+	if(shift && (key & 0xFF) == KEY_PGUP){
+		console_view(VROW_MAX);
+	}else if(shift && (key & 0xFF) == KEY_PGDOWN){
+		console_view(-VROW_MAX);
+	}else{
+		if(view){
+			// Typing returns to the bottom.
+			console_view(-view);
+		}
+		return false;
+	}
+	console_sync();
+	return true;
+}
+
+/**
+ * Flushes output from a clock event.
+ * @param event The flush event.
+ */
+static void console_flush_event(clock_event *event){
+	(void)event;
+	console_sync();
+}
+
+/**
+ * Queues a flush if none is pending.
+ * Until the clock runs nothing else flushes, so flush on each new line.
+ * @param newline A new line was started.
+ */
+static void console_schedule(bool newline){
+	if(!clock_running()){
+		if(newline){
+			console_sync();
+		}
+	}else if(!flush_event.queued){
+		clock_event_add(&flush_event, clock_ns() + CLOCK_NS_PER_SEC/FLUSH_RATE);
+	}
+}
+
 /**
  * Initiliaze the console I/O device.
+ * Must be called after frame_init().
+ * @param lines Number of rows to keep in the scrollback history.
  */
-void console_init(){
+void console_init(uint32_t lines){
+	uint32_t frames = (lines*VCOLS*sizeof(uint16_t) + FRAME_SIZE - 1) / FRAME_SIZE;
+	history = frames ? frame_alloc_contig(frames) : NULL;
+	if(history){
+		history_size = lines;
+		keyboard_set_hook(console_key);
+	}
 	
+	flush_event.handler = console_flush_event;
+}
+
+/**
+ * Mirrors console output to another device.
+ * Escape sequences are passed through unchanged.
+ * @param dev Device to copy output to, or NULL to stop mirroring.
+ */
+void console_mirror(device_descriptor *dev){
+	mirror = dev;
+}
+
+/**
+ * Writes a cell to the shadow buffer.
+ * @param pos Offset of the cell.
+ * @param cell Character and color to write.
+ */
+static inline void console_put(int16_t pos, uint16_t cell){
+	int8_t row = pos / VCOLS;
+	console_row(row)[pos - VPOS(0, row)] = cell;
+	dirty |= 1u << row;
+}
+
+/**
+ * Blanks a range of cells in the shadow buffer.
+ * @param start Offset of the first cell.
+ * @param end Offset past the last cell.
+ */
+static void console_blank(int16_t start, int16_t end){
+	while(start < end){
+		int8_t row = start / VCOLS;
+		int16_t col = start - VPOS(0, row);
+		int16_t count = VCOLS - col;
+		if(count > end - start){
+			count = end - start;
+		}
+		uint16_t *cells = console_row(row) + col;
+		for(int16_t i = 0; i < count; ++i){
+			cells[i] = VBLANK;
+		}
+		dirty |= 1u << row;
+		start += count;
+	}
 }
 
 /**
@@ -132,7 +373,6 @@ static void console_setcursor(int8_t col, int8_t row){
 	if(vcol > VCOL_MAX){
 		vcol = VCOL_MAX;
 	}
-	vga_desc.bwrite(VGA_ADDR_CURSOR, VPOS(vcol, vrow));
 }
 
 /**
@@ -156,19 +396,12 @@ void console_mvcursor(int16_t amount){
  */
 static void console_clear(enum clear_amount amount){
 	if(amount == CLEAR_ALL){
-		for(int i = 0; i < VROWS*VCOLS; ++i){
-			vga_desc.bwrite(i, VBLANK);
-			console_setcursor(0, 0);
-		}
+		console_blank(0, VROWS*VCOLS);
 		console_setcursor(0, 0);
 	}else if(amount == CLEAR_BEFORE){
-		for(int i = 0; i < vrow*vcol; ++i){
-			vga_desc.bwrite(i, VBLANK);
-		}
+		console_blank(0, VPOS(vcol, vrow));
 	}else{
-		for(int i = vrow*vcol; i < 0; ++i){
-			vga_desc.bwrite(i, VBLANK);
-		}
+		console_blank(VPOS(vcol, vrow), VROWS*VCOLS);
 	}
 }
 
@@ -178,18 +411,12 @@ static void console_clear(enum clear_amount amount){
  */
 static void console_clearln(enum clear_amount amount){
 	if(amount == CLEAR_ALL){
-		for(int i = 0; i < VCOLS; ++i){
-			vga_desc.bwrite(VPOS(i, vrow), VBLANK);
-			console_setcursor(0, vrow);
-		}
+		console_blank(VPOS(0, vrow), VPOS(0, vrow+1));
+		console_setcursor(0, vrow);
 	}else if(amount == CLEAR_BEFORE){
-		for(int i = 0; i < vcol; ++i){
-			vga_desc.bwrite(VPOS(i, vrow), VBLANK);
-		}
+		console_blank(VPOS(0, vrow), VPOS(vcol, vrow));
 	}else{
-		for(int i = vcol; i < VCOLS; ++i){
-			vga_desc.bwrite(VPOS(i, vrow), VBLANK);
-		}
+		console_blank(VPOS(vcol, vrow), VPOS(0, vrow+1));
 	}
 }
 
@@ -198,24 +425,51 @@ static void console_clearln(enum clear_amount amount){
  * @param amount Number or lines to scroll.
  */
 static void console_scroll(int8_t amount){
+	if(amount > VROWS){
+		amount = VROWS;
+	}else if(amount < -VROWS){
+		amount = -VROWS;
+	}
 	if(amount > 0){
-		for(int i = 0; i <= VPOS(VCOL_MAX, VROW_MAX); ++i){
-			if(i <= VPOS(VCOL_MAX, VROW_MAX-amount)){
-				vga_desc.bwrite(i, vga_desc.bread(i + (VCOLS*amount)));
-			}else{
-				vga_desc.bwrite(i, VBLANK);
+		uint32_t flags = int_save();
+		for(int8_t y = 0; y < amount && history; ++y){
+			// Keep the rows going off the top.
+			memcpy(&history[history_head*VCOLS], console_row(y), VCOLS*sizeof(uint16_t));
+			if(++history_head == history_size){
+				history_head = 0;
+			}
+			if(history_count < history_size){
+				++history_count;
+			}
+			if(view && view < history_count){
+				// Keep the view on the same rows.
+				++view;
 			}
 		}
+		top = (top + amount) % VROWS;
+		dirty >>= amount;
+		vstart += amount;
+		if(vstart > VRAM_ROWS - VROWS){
+			// Out of VRAM, start again from the beginning.
+			vstart = 0;
+			dirty = (1u << VROWS) - 1;
+		}
+		int_restore(flags);
+		console_blank(VPOS(0, VROWS-amount), VROWS*VCOLS);
 		console_setcursor(0, VROW_MAX);
 	}else if(amount < 0){
 		amount = -amount;
-		for(int i = VPOS(VCOL_MAX, VROW_MAX); i >= 0; --i){
-			if(i > VPOS(VCOL_MAX, amount-1)){
-				vga_desc.bwrite(i, vga_desc.bread(i - (VCOLS*amount)));
-			}else{
-				vga_desc.bwrite(i, VBLANK);
-			}
+		uint32_t flags = int_save();
+		top = (top + VROWS - amount) % VROWS;
+		dirty = (dirty << amount) & ((1u << VROWS) - 1);
+		vstart -= amount;
+		if(vstart < 0){
+			// Out of VRAM, start again from the end.
+			vstart = VRAM_ROWS - VROWS;
+			dirty = (1u << VROWS) - 1;
 		}
+		int_restore(flags);
+		console_blank(0, VPOS(0, amount));
 		console_setcursor(0, 0);
 	}
 }
@@ -468,11 +722,38 @@ static void proc_escape(unsigned char ch){
 }
 
 /**
- * Write to console output.
+ * Calculates the color of new text.
+ * @return The color code in the high byte of a cell.
+ */
+static uint16_t console_color(){
+	uint8_t outc = COLOR(vbg, vfg);
+	if(reverse){
+		outc = (outc >> 4) | (outc << 4);
+	}
+	if(bright){
+		outc = outc | 0x08;
+	}
+	return outc << 8;
+}
+
+/**
+ * Moves the cursor to the start of the next line, scrolling if needed.
+ */
+static void console_newline(){
+	vcol = 0;
+	++vrow;
+	if(vrow > VROW_MAX){
+		console_scroll(1);
+		vrow = VROW_MAX;
+	}
+	console_setcursor(vcol, vrow);
+}
+
+/**
+ * Draws a character on the console without mirroring it.
  * @param value Value to write.
- * @return Error code or EOK.
  */
-int console_write(char value){
+static void console_putc(char value){
 	if(escaped){
 		proc_escape(value);
 	}else if(value == '\e'){
@@ -480,56 +761,105 @@ int console_write(char value){
 		console_setcursor(vcol, vrow);
 	}else if(!conceal){
 		if(value == '\n'){
-			vcol = 0;
-			++vrow;
-			if(vrow > VROW_MAX){
-				console_scroll(1);
-				vrow = VROW_MAX;
-			}
-			console_setcursor(vcol, vrow);
+			console_newline();
 		}else if(value == '\t'){
 			int count = TAB_WIDTH - (vcol % TAB_WIDTH);
 			for(int i = 0; i < count; ++i){
-				console_write(' ');
+				console_putc(' ');
 				if(!vcol){
 					break;
 				}
 			}
 		}else if(isprint(value)){
-			uint8_t outc = COLOR(vbg, vfg);
-			if(reverse){
-				outc = (outc >> 4) | (outc << 4);
-			}
-			if(bright){
-				outc = outc | 0x08;
-			}
-			vga_desc.bwrite(VPOS(vcol, vrow), (outc << 8) | value);
+			console_put(VPOS(vcol, vrow), console_color() | value);
 			++vcol;
 		}
 		if(vcol > VCOL_MAX){
-			vcol = 0;
-			++vrow;
-			if(vrow > VROW_MAX){
-				console_scroll(1);
-				vrow = VROW_MAX;
-			}
-			console_setcursor(vcol, vrow);
+			console_newline();
 		}
 	}
 	++(console_desc.write_count);
+}
+
+/**
+ * Write to console output.
+ * @param value Value to write.
+ * @return Error code or EOK.
+ */
+int console_write(char value){
+	if(mirror){
+		device_write(mirror, 0, &value, 1);
+	}
+	uint32_t flags = int_save();
+	console_putc(value);
+	console_schedule(value == '\n');
+	int_restore(flags);
 	return EOK;
 }
 
 /**
- * Read from the console input.
- * @return The value read.
+ * Writes a buffer to the console output.
+ * Runs of printable characters are copied straight into the row.
+ * @param addr Ignored.
+ * @param buf Buffer to write.
+ * @param count Number of bytes to write.
+ * @return Number of bytes written.
  */
-char console_read(){
-	console_setcursor(-1, -1);
-	char ch = keyboard_get_key() & 0xFF;
+ssize_t console_writebuf(unsigned int addr, const void *buf, size_t count){
+	(void)addr;
+	const char *str = buf;
+	if(mirror){
+		device_write(mirror, 0, buf, count);
+	}
+	// Threads writing at once would tear the cursor and the rows.
+	uint32_t flags = int_save();
+	size_t i = 0;
+	while(i < count){
+		if(escaped || conceal || !isprint(str[i])){
+			console_putc(str[i++]);
+			continue;
+		}
+		uint16_t color = console_color();
+		uint16_t *cells = console_row(vrow);
+		size_t start = i;
+		while(i < count && vcol <= VCOL_MAX && isprint(str[i])){
+			cells[vcol++] = color | str[i++];
+		}
+		dirty |= 1u << vrow;
+		console_desc.write_count += i - start;
+		if(vcol > VCOL_MAX){
+			console_newline();
+		}
+	}
+	console_schedule(memchr(buf, '\n', count) != NULL);
+	int_restore(flags);
+	return count;
+}
+
+/**
+ * Writes a list of buffers to the console output.
+ * @param addr Ignored.
+ * @param iov Buffers to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written.
+ */
+ssize_t console_writev(unsigned int addr, const struct iovec *iov, int iovcnt){
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		total += console_writebuf(addr, iov[i].iov_base, iov[i].iov_len);
+	}
+	return total;
+}
+
+/**
+ * Echoes a key stroke read from the console input.
+ * @param key The key stroke.
+ * @return The character read.
+ */
+static char console_echo(uint16_t key){
+	char ch = key & 0xFF;
 	if(isprint(ch) || isspace(ch)){
 		console_write(ch);
-		console_setcursor(-1, -1);
 	}else if(ch == '\b'){
 		console_mvcursor(-1);
 		console_write(' ');
@@ -539,11 +869,45 @@ char console_read(){
 	return ch;
 }
 
+/**
+ * Read from the console input.
+ * Blocks the calling thread until a key is pressed, unless interrupts are
+ * disabled.
+ * @return The value read.
+ */
+char console_read(){
+	console_sync();
+	return console_echo(keyboard_wait_key());
+}
+
+/**
+ * Reads the keys waiting in the console input.
+ * @param addr Ignored.
+ * @param buf Buffer to read into.
+ * @param count Maximum number of bytes to read.
+ * @return Number of bytes read.
+ */
+ssize_t console_readbuf(unsigned int addr, void *buf, size_t count){
+	(void)addr;
+	console_sync();
+	char *str = buf;
+	size_t i = 0;
+	uint16_t key;
+	while(i < count && (key = keyboard_get_key())){
+		str[i++] = console_echo(key);
+	}
+	return i;
+}
+
 /**
  * Flushes the console input and output streams.
  * @return Error code or EOK.
  */
 int console_flush(){
+	console_sync();
+	if(mirror){
+		mirror->flush();
+	}
 	keyboard_clear_buffer();
 	return EOK;
 }
@@ -555,6 +919,7 @@ device_descriptor console_desc = {
 	0, 0,
 	0, 0,
 	0, 0,
-	console_read, console_write, console_flush
+	console_read, console_write, console_flush,
+	console_readbuf, console_writebuf, console_writev
 };
 
@@ -7,9 +7,24 @@
 #ifndef __HAL_CONSOLE_H_
 #define __HAL_CONSOLE_H_
 
+#include <stdint.h>
 #include "device.h"
 
 //! Console I/O device descriptor.
 device_descriptor console_desc;
 
+/**
+ * Initiliaze the console I/O device.
+ * Must be called after pit_init() and frame_init().
+ * @param lines Number of rows to keep in the scrollback history.
+ */
+void console_init(uint32_t lines);
+
+/**
+ * Mirrors console output to another device.
+ * Escape sequences are passed through unchanged.
+ * @param dev Device to copy output to, or NULL to stop mirroring.
+ */
+void console_mirror(device_descriptor *dev);
+
 #endif /* __HAL_CONSOLE_H_ */
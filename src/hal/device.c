@@ -0,0 +1,95 @@
+/**
+ * @file hal/device.c
+ * Generic device I/O.
+ * @author Conlan Wesson
+ */
+
+#include "device.h"
+
+#include <errno.h>
+
+/**
+ * Reads a buffer from a device.
+ * Uses the single byte stream functions if the device has no read().
+ * @param dev The device to read from.
+ * @param addr Address to read from, ignored by stream devices.
+ * @param buf Buffer to read into.
+ * @param count Maximum number of bytes to read.
+ * @return Number of bytes read, or -1 with errno set.
+ */
+ssize_t device_read(device_descriptor *dev, unsigned int addr, void *buf, size_t count){
+	if(dev->read){
+		return dev->read(addr, buf, count);
+	}
+	if(!dev->sread){
+		errno = ENOTSUP;
+		return -1;
+	}
+	char *str = buf;
+	for(size_t i = 0; i < count; ++i){
+		str[i] = dev->sread();
+	}
+	return count;
+}
+
+/**
+ * Writes a buffer to a device.
+ * Uses the single byte stream functions if the device has no write().
+ * @param dev The device to write to.
+ * @param addr Address to write to, ignored by stream devices.
+ * @param buf Buffer to write.
+ * @param count Number of bytes to write.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t device_write(device_descriptor *dev, unsigned int addr, const void *buf, size_t count){
+	if(dev->write){
+		return dev->write(addr, buf, count);
+	}
+	if(!dev->swrite){
+		errno = ENOTSUP;
+		return -1;
+	}
+	const char *str = buf;
+	for(size_t i = 0; i < count; ++i){
+		int ret = dev->swrite(str[i]);
+		if(ret != EOK){
+			if(i == 0){
+				errno = ret;
+				return -1;
+			}
+			return i;
+		}
+	}
+	return count;
+}
+
+/**
+ * Writes a list of buffers to a device.
+ * Uses write() for each buffer if the device has no writev().
+ * @param dev The device to write to.
+ * @param addr Address to write to, ignored by stream devices.
+ * @param iov Buffers to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t device_writev(device_descriptor *dev, unsigned int addr, const struct iovec *iov, int iovcnt){
+	if(iovcnt < 0 || iovcnt > IOV_MAX){
+		errno = EINVAL;
+		return -1;
+	}
+	if(dev->writev){
+		return dev->writev(addr, iov, iovcnt);
+	}
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		ssize_t ret = device_write(dev, addr + total, iov[i].iov_base, iov[i].iov_len);
+		if(ret < 0){
+			return total ? total : ret;
+		}
+		total += ret;
+		if((size_t)ret < iov[i].iov_len){
+			break;
+		}
+	}
+	return total;
+}
@@ -9,6 +9,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #define DEVICE_FLAG_IN    0x01    //!< Flag for input devices.
 #define DEVICE_FLAG_OUT   0x02    //!< Flag for output devices.
@@ -66,6 +68,66 @@ typedef struct device_descriptor{
 	 * @return Error code or EOK.
 	 */
 	int (*flush)();
+	
+	/**
+	 * Reads a buffer from the device.
+	 * @param addr Address to read from, ignored by stream devices.
+	 * @param buf Buffer to read into.
+	 * @param count Maximum number of bytes to read.
+	 * @return Number of bytes read, or -1 with errno set.
+	 */
+	ssize_t (*read)(unsigned int addr, void *buf, size_t count);
+	
+	/**
+	 * Writes a buffer to the device.
+	 * @param addr Address to write to, ignored by stream devices.
+	 * @param buf Buffer to write.
+	 * @param count Number of bytes to write.
+	 * @return Number of bytes written, or -1 with errno set.
+	 */
+	ssize_t (*write)(unsigned int addr, const void *buf, size_t count);
+	
+	/**
+	 * Writes a list of buffers to the device.
+	 * @param addr Address to write to, ignored by stream devices.
+	 * @param iov Buffers to write.
+	 * @param iovcnt Number of buffers.
+	 * @return Number of bytes written, or -1 with errno set.
+	 */
+	ssize_t (*writev)(unsigned int addr, const struct iovec *iov, int iovcnt);
 } device_descriptor;
 
+/**
+ * Reads a buffer from a device.
+ * Uses the single byte stream functions if the device has no read().
+ * @param dev The device to read from.
+ * @param addr Address to read from, ignored by stream devices.
+ * @param buf Buffer to read into.
+ * @param count Maximum number of bytes to read.
+ * @return Number of bytes read, or -1 with errno set.
+ */
+ssize_t device_read(device_descriptor *dev, unsigned int addr, void *buf, size_t count);
+
+/**
+ * Writes a buffer to a device.
+ * Uses the single byte stream functions if the device has no write().
+ * @param dev The device to write to.
+ * @param addr Address to write to, ignored by stream devices.
+ * @param buf Buffer to write.
+ * @param count Number of bytes to write.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t device_write(device_descriptor *dev, unsigned int addr, const void *buf, size_t count);
+
+/**
+ * Writes a list of buffers to a device.
+ * Uses write() for each buffer if the device has no writev().
+ * @param dev The device to write to.
+ * @param addr Address to write to, ignored by stream devices.
+ * @param iov Buffers to write.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written, or -1 with errno set.
+ */
+ssize_t device_writev(device_descriptor *dev, unsigned int addr, const struct iovec *iov, int iovcnt);
+
 #endif /* __HAL_DEVICE_H_ */
@@ -26,6 +26,49 @@ int null_write(char value){
 	return EOK;
 }
 
+/**
+ * Always reads nothing.
+ * @param addr Ignored.
+ * @param buf Ignored.
+ * @param count Ignored.
+ * @return Zero, for end of file.
+ */
+ssize_t null_readbuf(unsigned int addr, void *buf, size_t count){
+	(void)addr;
+	(void)buf;
+	(void)count;
+	return 0;
+}
+
+/**
+ * Discards a buffer.
+ * @param addr Ignored.
+ * @param buf Ignored.
+ * @param count Number of bytes to discard.
+ * @return count
+ */
+ssize_t null_writebuf(unsigned int addr, const void *buf, size_t count){
+	(void)addr;
+	(void)buf;
+	return count;
+}
+
+/**
+ * Discards a list of buffers.
+ * @param addr Ignored.
+ * @param iov Buffers to discard.
+ * @param iovcnt Number of buffers.
+ * @return Total size of the buffers.
+ */
+ssize_t null_writev(unsigned int addr, const struct iovec *iov, int iovcnt){
+	(void)addr;
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
 /**
  * Always returns EOK
  * @return EOK
@@ -43,5 +86,6 @@ device_descriptor null_desc = {
 	0, 0,
 	0, 0,
 	0, 0,
-	null_read, null_write, null_flush
+	null_read, null_write, null_flush,
+	null_readbuf, null_writebuf, null_writev
 };
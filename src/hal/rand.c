@@ -74,6 +74,53 @@ char rand_read(){
 	return (y >> 20) & 0x000000FF;
 }
 
+/**
+ * Fills a buffer with random bytes.
+ * @param addr Ignored.
+ * @param buf Buffer to fill.
+ * @param count Number of bytes to fill.
+ * @return count
+ */
+ssize_t rand_readbuf(unsigned int addr, void *buf, size_t count){
+	(void)addr;
+	char *bytes = buf;
+	for(size_t i = 0; i < count; ++i){
+		bytes[i] = rand_read();
+	}
+	return count;
+}
+
+/**
+ * Seeds the RNG from a buffer.
+ * Each byte reseeds the generator, so only the last one matters.
+ * @param addr Ignored.
+ * @param buf Buffer of seed bytes.
+ * @param count Number of bytes.
+ * @return count
+ */
+ssize_t rand_writebuf(unsigned int addr, const void *buf, size_t count){
+	(void)addr;
+	if(count){
+		rand_write(((const char*)buf)[count-1]);
+	}
+	return count;
+}
+
+/**
+ * Seeds the RNG from a list of buffers.
+ * @param addr Ignored.
+ * @param iov Buffers of seed bytes.
+ * @param iovcnt Number of buffers.
+ * @return Total size of the buffers.
+ */
+ssize_t rand_writev(unsigned int addr, const struct iovec *iov, int iovcnt){
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		total += rand_writebuf(addr, iov[i].iov_base, iov[i].iov_len);
+	}
+	return total;
+}
+
 /**
  * Always returns EOK.
  * @return EOK
@@ -91,6 +138,7 @@ device_descriptor rand_desc = {
 	0, 0,
 	0, 0,
 	0, 0,
-	rand_read, rand_write, rand_flush
+	rand_read, rand_write, rand_flush,
+	rand_readbuf, rand_writebuf, rand_writev
 };
 
@@ -7,6 +7,7 @@
 #include "zero.h"
 
 #include <errno.h>
+#include <string.h>
 
 /**
  * Always returns zero.
@@ -26,6 +27,48 @@ int zero_write(char value){
 	return EOK;
 }
 
+/**
+ * Fills a buffer with zeros.
+ * @param addr Ignored.
+ * @param buf Buffer to fill.
+ * @param count Number of bytes to fill.
+ * @return count
+ */
+ssize_t zero_readbuf(unsigned int addr, void *buf, size_t count){
+	(void)addr;
+	memset(buf, 0, count);
+	return count;
+}
+
+/**
+ * Discards a buffer.
+ * @param addr Ignored.
+ * @param buf Ignored.
+ * @param count Number of bytes to discard.
+ * @return count
+ */
+ssize_t zero_writebuf(unsigned int addr, const void *buf, size_t count){
+	(void)addr;
+	(void)buf;
+	return count;
+}
+
+/**
+ * Discards a list of buffers.
+ * @param addr Ignored.
+ * @param iov Buffers to discard.
+ * @param iovcnt Number of buffers.
+ * @return Total size of the buffers.
+ */
+ssize_t zero_writev(unsigned int addr, const struct iovec *iov, int iovcnt){
+	(void)addr;
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; ++i){
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
 /**
  * Always returns EOK.
  * @return EOK
@@ -43,5 +86,6 @@ device_descriptor zero_desc = {
 	0, 0,
 	0, 0,
 	0, 0,
-	zero_read, zero_write, zero_flush
+	zero_read, zero_write, zero_flush,
+	zero_readbuf, zero_writebuf, zero_writev
 };
@@ -0,0 +1,35 @@
+/**
+ * @file include/kernel/cpuid.h
+ * Kernel operations for identifying the processor.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_KERNEL_CPUID_H_
+#define __INCLUDE_KERNEL_CPUID_H_
+
+/**
+ * Struct for returning CPUID outputs.
+ */
+struct cpuid_out{
+	int eax;  //!< Contents of the EAX register.
+	int ebx;  //!< Contents of the EBX register.
+	int ecx;  //!< Contents of the ECX register.
+	int edx;  //!< Contents of the EDX register.
+};
+
+/**
+ * Runs a CPUID instruction.
+ * @param func The function code to run CPUID.
+ * @return Register output of the CPUID instruction.
+ */
+static inline struct cpuid_out cpuid(int func){
+	struct cpuid_out out;
+	asm volatile(
+		"cpuid;"
+		:"=a"(out.eax), "=b"(out.ebx), "=c"(out.ecx), "=d"(out.edx)
+		:"eax"(func)
+	);
+	return out;
+}
+
+#endif /* __INCLUDE_KERNEL_CPUID_H_ */
@@ -0,0 +1,31 @@
+/**
+ * @file include/kernel/div.h
+ * Kernel operations for 64bit division.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_KERNEL_DIV_H_
+#define __INCLUDE_KERNEL_DIV_H_
+
+#include <stdint.h>
+
+/**
+ * Divides a 64bit number by a 32bit number.
+ * Uses the 64 by 32 bit divide instruction so no libgcc helper is needed.
+ * @param num The number to divide, replaced by the quotient.
+ * @param div The divisor.
+ * @return The remainder.
+ */
+static inline uint32_t div64_32(uint64_t *num, uint32_t div){
+	uint32_t hi = (uint32_t)(*num >> 32);
+	uint32_t lo = (uint32_t)*num;
+	uint32_t quo_hi = hi / div;
+	uint32_t rem = hi % div;
+	uint32_t quo_lo;
+	// rem < div, so the quotient fits in 32 bits.
+	asm("divl %4" : "=a"(quo_lo), "=d"(rem) : "a"(lo), "d"(rem), "rm"(div));
+	*num = ((uint64_t)quo_hi << 32) | quo_lo;
+	return rem;
+}
+
+#endif /* __INCLUDE_KERNEL_DIV_H_ */
@@ -7,18 +7,55 @@
 #ifndef __INCLUDE_KERNEL_INT_H_
 #define __INCLUDE_KERNEL_INT_H_
 
+#include <stdint.h>
+
 /**
  * Enable interrupts.
  */
 static inline void sti(){
-	asm volatile("sti");
+	asm volatile("sti" ::: "memory");
 }
 
 /**
  * Disable interrupts.
  */
 static inline void cli(){
-	asm volatile("cli");
+	asm volatile("cli" ::: "memory");
+}
+
+/**
+ * Disable interrupts, saving the previous state.
+ * @return The flags register before interrupts were disabled.
+ */
+static inline uint32_t int_save(){
+	uint32_t flags;
+	asm volatile(
+		"pushfl;"
+		"popl %0;"
+		"cli"
+		:"=r"(flags)
+		:: "memory"
+	);
+	return flags;
+}
+
+/**
+ * Restore the interrupt state saved by int_save().
+ * @param flags The flags register returned by int_save().
+ */
+static inline void int_restore(uint32_t flags){
+	if(flags & 0x200){    // Interrupt enable flag.
+		sti();
+	}
+}
+
+/**
+ * Enable interrupts and halt until the next one arrives.
+ * Call with interrupts disabled after checking there is nothing to do, an
+ * interrupt cannot slip in between the two instructions.
+ */
+static inline void int_wait(){
+	asm volatile("sti; hlt" ::: "memory");
 }
 
 #endif
@@ -0,0 +1,25 @@
+/**
+ * @file include/kernel/tsc.h
+ * Kernel operations for the time stamp counter.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_KERNEL_TSC_H_
+#define __INCLUDE_KERNEL_TSC_H_
+
+#include <stdint.h>
+
+/**
+ * Reads the time stamp counter.
+ * @return The number of cycles since reset.
+ */
+static inline uint64_t rdtsc(){
+	uint64_t ret;
+	asm volatile(
+		"rdtsc"
+		:"=A"(ret)
+	);
+	return ret;
+}
+
+#endif /* __INCLUDE_KERNEL_TSC_H_ */
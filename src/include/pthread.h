@@ -7,6 +7,8 @@
 #ifndef __INCLUDE_PTHREAD_H_
 #define __INCLUDE_PTHREAD_H_
 
+#include "sys/thread.h"
+
 enum {
 	PTHREAD_PRIO_NONE,
 	PTHREAD_PRIO_INHERIT,
@@ -25,6 +27,16 @@ enum {
 	PTHREAD_MUTEX_DEFAULT,
 };
 
+struct thread;
+
+//! Thread handle
+typedef struct thread *pthread_t;
+
+//! Thread attributes
+typedef struct {
+	int prio;    //!< Scheduling priority, 1 to 31, higher runs first.
+} pthread_attr_t;
+
 //! Mutex attributes
 typedef struct {
 	char prio;
@@ -38,8 +50,52 @@ typedef struct {
 	volatile int lock;
 	volatile int count;
 	pthread_mutexattr_t attr;
+	thread_queue waiters;    //!< Threads blocked in pthread_mutex_lock().
 } pthread_mutex_t;
 
+/**
+ * Initialize thread attributes to the defaults.
+ * @param attr Attributes to initialize.
+ * @return EOK is successful, error code otherwise.
+ */
+int pthread_attr_init(pthread_attr_t* attr);
+
+/**
+ * Create a kernel thread.
+ * @param thread Set to the new thread.
+ * @param attr Attributes of the thread, or NULL for the defaults.
+ * @param start_routine Function for the thread to run.
+ * @param arg Argument for the function.
+ * @return EOK is successful, error code otherwise.
+ */
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void *(*start_routine)(void*), void* arg);
+
+/**
+ * Wait for a thread to exit.
+ * @param thread Thread to wait for.
+ * @param value_ptr Set to the thread's return value, may be NULL.
+ * @return EOK is successful, error code otherwise.
+ */
+int pthread_join(pthread_t thread, void** value_ptr);
+
+/**
+ * Let other threads run.
+ * @return EOK is successful, error code otherwise.
+ */
+int pthread_yield();
+
+/**
+ * Get the calling thread.
+ * @return The calling thread.
+ */
+pthread_t pthread_self();
+
+/**
+ * End the calling thread.
+ * @param value_ptr Value for pthread_join().
+ */
+void pthread_exit(void* value_ptr) __attribute__((noreturn));
+
 /**
  * Initialize pthread mutex.
  * @param mutex Mutex to initialize.
@@ -57,6 +113,7 @@ int pthread_mutex_trylock(pthread_mutex_t* mutex);
 
 /**
  * Lock pthread mutex.
+ * The calling thread blocks until the mutex is unlocked.
  * @param mutex Mutex to lock.
  * @return EOK is successful, error code otherwise.
  */
@@ -64,6 +121,7 @@ int pthread_mutex_lock(pthread_mutex_t* mutex);
 
 /**
  * Unlock pthread mutex.
+ * Wakes the first thread blocked on the mutex.
  * @param mutex Mutex to unlock.
  * @return EOK is successful, error code otherwise.
  */
@@ -0,0 +1,99 @@
+/**
+ * @file include/ring.h
+ * Lock-free single-producer single-consumer ring buffer.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_RING_H_
+#define __INCLUDE_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64    //!< Size of a cache line, keeps the two sides apart.
+
+/**
+ * Ring buffer of fixed size elements.
+ * One producer may push while one consumer pops, from an interrupt handler
+ * and a task for example, without any locking.  The producer only writes
+ * head and the consumer only writes tail.  Both are free-running counters,
+ * the capacity being a power of two makes wrapping a mask.
+ */
+typedef struct ring{
+	uint8_t *data;                                           //!< Element storage.
+	size_t elem_size;                                        //!< Size of each element in bytes.
+	uint32_t mask;                                           //!< Capacity minus one.
+	volatile uint32_t head __attribute__((aligned(RING_CACHE_LINE)));    //!< Elements pushed, written by the producer.
+	volatile uint32_t tail __attribute__((aligned(RING_CACHE_LINE)));    //!< Elements popped, written by the consumer.
+} __attribute__((aligned(RING_CACHE_LINE))) ring;
+
+/**
+ * Initializes a ring.
+ * @param r The ring to initialize.
+ * @param data Storage for capacity elements of elem_size bytes.
+ * @param capacity Number of elements, must be a power of two.
+ * @param elem_size Size of each element in bytes.
+ * @return Error code, or EOK if successful.
+ */
+int ring_init(ring *r, void *data, uint32_t capacity, size_t elem_size);
+
+/**
+ * Adds an element to the ring, called only by the producer.
+ * @param r The ring.
+ * @param elem The element to copy in.
+ * @return true if the element was added, false if the ring is full.
+ */
+bool ring_push(ring *r, const void *elem);
+
+/**
+ * Removes an element from the ring, called only by the consumer.
+ * @param r The ring.
+ * @param elem Where to copy the element.
+ * @return true if an element was removed, false if the ring is empty.
+ */
+bool ring_pop(ring *r, void *elem);
+
+/**
+ * Adds as many elements as fit, called only by the producer.
+ * @param r The ring.
+ * @param elems The elements to copy in.
+ * @param count Number of elements.
+ * @return Number of elements added.
+ */
+uint32_t ring_push_bulk(ring *r, const void *elems, uint32_t count);
+
+/**
+ * Removes as many elements as are waiting, called only by the consumer.
+ * @param r The ring.
+ * @param elems Where to copy the elements.
+ * @param count Maximum number of elements.
+ * @return Number of elements removed.
+ */
+uint32_t ring_pop_bulk(ring *r, void *elems, uint32_t count);
+
+/**
+ * Discards every waiting element, called only by the consumer.
+ * @param r The ring.
+ */
+void ring_clear(ring *r);
+
+/**
+ * Gets the number of elements waiting in the ring.
+ * @param r The ring.
+ * @return Number of elements waiting.
+ */
+static inline uint32_t ring_count(const ring *r){
+	return r->head - r->tail;
+}
+
+/**
+ * Gets the number of elements that can be pushed.
+ * @param r The ring.
+ * @return Number of free slots.
+ */
+static inline uint32_t ring_space(const ring *r){
+	return r->mask + 1 - ring_count(r);
+}
+
+#endif
@@ -7,6 +7,8 @@
 #ifndef __INCLUDE_STDIO_H_
 #define __INCLUDE_STDIO_H_
 
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "hal/device.h"
@@ -15,13 +17,34 @@ enum {
 	EOF = -1,    //!< End-of-File indicator.
 };
 
+//! Buffering modes for setvbuf().
+enum {
+	_IOFBF,    //!< Fully buffered, written when the buffer is full.
+	_IOLBF,    //!< Line buffered, written at each newline.
+	_IONBF     //!< Unbuffered, written immediately.
+};
+
+#define BUFSIZ 1024    //!< Size of the standard stream buffers.
+
 #ifndef NULL
 	#define NULL ((void*)0)    //!< Null pointer
 #endif
 
-device_descriptor *stdout;    //!< Pointer to standard output stream.
-device_descriptor *stderr;    //!< Pointer to standard error stream.
-device_descriptor *stdin;     //!< Pointer to standard input stream.
+/**
+ * Buffered stream on a device.
+ */
+typedef struct FILE{
+	device_descriptor *dev;    //!< Device the stream reads and writes.
+	char *buf;                 //!< Output buffer.
+	size_t size;               //!< Size of the output buffer.
+	size_t len;                //!< Number of bytes waiting in the buffer.
+	int mode;                  //!< Buffering mode, _IOFBF, _IOLBF or _IONBF.
+	bool error;                //!< A write to the device has failed.
+} FILE;
+
+FILE *stdout;    //!< Pointer to standard output stream.
+FILE *stderr;    //!< Pointer to standard error stream.
+FILE *stdin;     //!< Pointer to standard input stream.
 
 /**
  * Enum to determine how putnum displays the sign.
@@ -34,6 +57,50 @@ enum putnum_sign {
 	PUTNUM_SIGN_PEMBED     //!< Show both negative and positive sign after padding.
 };
 
+/**
+ * Sets the buffering mode of a stream.
+ * Any buffered output is written first.
+ * @param stream The stream to change.
+ * @param buf Buffer to use, or NULL to keep the current buffer.
+ * @param mode One of _IOFBF, _IOLBF or _IONBF.
+ * @param size Size of buf.
+ * @return Zero if successful, non-zero otherwise.
+ */
+int setvbuf(FILE *stream, char *buf, int mode, size_t size);
+
+/**
+ * Writes any buffered output of a stream to its device.
+ * @param stream The stream to flush, or NULL for all streams.
+ * @return Zero if successful, EOF otherwise.
+ */
+int fflush(FILE *stream);
+
+/**
+ * Writes an array of elements to a stream.
+ * @param ptr The elements to write.
+ * @param size Size of each element.
+ * @param nmemb Number of elements.
+ * @param stream The stream to write to.
+ * @return Number of elements written.
+ */
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+
+/**
+ * Writes a character to a stream.
+ * @param ch Character to write.
+ * @param stream The stream to write to.
+ * @return ch if successful, EOF otherwise.
+ */
+int fputc(int ch, FILE *stream);
+
+/**
+ * Writes a string to a stream.
+ * @param str String to write.
+ * @param stream The stream to write to.
+ * @return Non-negative if successful, EOF otherwise.
+ */
+int fputs(const char *str, FILE *stream);
+
 /**
  * Writes a string to stdout.
  * @param str String to write.
@@ -49,6 +116,67 @@ int puts(const char *);
  */
 int printf(const char *, ...);
 
+/**
+ * Prints a string to a stream using the specified format.
+ * @param stream The stream to write to.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int fprintf(FILE *, const char *, ...);
+
+/**
+ * Prints a string to a stream using the specified format.
+ * @param stream The stream to write to.
+ * @param format Format string.
+ * @param ap The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int vfprintf(FILE *, const char *, va_list);
+
+/**
+ * Prints a string straight to a device using the specified format.
+ * Nothing is buffered, so this is safe where streams are not.
+ * @param dev The device to write to.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int devprintf(device_descriptor *, const char *, ...);
+
+/**
+ * Formats a string into a buffer.
+ * At most n-1 characters are written, followed by a terminator.
+ * @param buf Buffer to write to, may be NULL if n is zero.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Length of the whole formatted string, even if it was truncated.
+ */
+int snprintf(char *, size_t, const char *, ...);
+
+/**
+ * Formats a string into a buffer.
+ * At most n-1 characters are written, followed by a terminator.
+ * @param buf Buffer to write to, may be NULL if n is zero.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ap The values used in the format.
+ * @return Length of the whole formatted string, even if it was truncated.
+ */
+int vsnprintf(char *, size_t, const char *, va_list);
+
+/**
+ * Formats a string into a buffer, failing if it does not fit.
+ * @param buf Buffer to write to.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Length of the formatted string, or zero if a runtime-constraint
+ * is violated.
+ */
+int sprintf_s(char *, rsize_t, const char *, ...);
+
 /**
  * Writes a string to stderr.
  * @param str String to write.
@@ -8,13 +8,43 @@
 #define __INCLUDE_STDLIB_H_
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 enum {
 	EXIT_FAILURE = -1,    //!< Unsuccessful termination.
 	EXIT_SUCCESS =  0,    //!< Successful termination.
 };
 
+enum {
+	HEAP_STAT_CLASSES = 9    //!< Eight size classes from 16 to 2048 bytes, then large blocks.
+};
+
+/**
+ * Heap statistics.
+ */
+typedef struct heap_stats{
+	size_t used;                                //!< Bytes allocated, after rounding to the block size.
+	size_t peak;                                //!< Highest value of used.
+	size_t free;                                //!< Bytes in free blocks.
+	size_t largest;                             //!< Size of the largest free block.
+	uint32_t fragmentation;                     //!< Percent of free bytes outside the largest free block.
+	uint32_t allocs;                            //!< Number of allocations.
+	uint32_t frees;                             //!< Number of frees.
+	uint32_t class_allocs[HEAP_STAT_CLASSES];   //!< Number of allocations in each size class.
+} heap_stats;
+
+/**
+ * Heap trace entry.
+ */
+typedef struct heap_trace_entry{
+	void *ptr;       //!< Address allocated or freed.
+	size_t size;     //!< Usable size of the allocation.
+	void *caller;    //!< Return address of the caller.
+	bool alloc;      //!< true for an allocation, false for a free.
+} heap_trace_entry;
+
 /**
  * Initializes the heap.
  * @param start Null terminated array of pointers to the start of heap spaces.
@@ -30,12 +60,57 @@ int heap_init(void*[], void*[]);
  */
 void *malloc(size_t);
 
+/**
+ * Allocates zeroed memory for an array on the heap.
+ * @param count Number of elements.
+ * @param size Size of each element.
+ * @return Pointer to the allocated space, or NULL on failure or overflow.
+ */
+void *calloc(size_t count, size_t size);
+
+/**
+ * Allocates aligned memory on the heap.
+ * @param align Alignment of the space, a power of two.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the allocated space, or NULL on failure.
+ */
+void *aligned_alloc(size_t align, size_t size);
+
+/**
+ * Changes the size of an allocation on the heap.
+ * The contents are kept up to the smaller of the old and new sizes.
+ * @param ptr Pointer to the space to resize, or NULL to allocate.
+ * @param size New number of bytes.
+ * @return Pointer to the resized space, or NULL on failure.
+ */
+void *realloc(void *ptr, size_t size);
+
 /**
  * Deallocates space on the heap.
  * @param ptr Pointer to the space to deallocate.
  */
 void free(void *ptr);
 
+/**
+ * Gets the heap statistics.
+ * @param out Structure to fill.
+ */
+void heap_get_stats(heap_stats *out);
+
+/**
+ * Enables or disables tracing of allocations and frees.
+ * @param enable true to record a trace.
+ */
+void heap_trace(bool enable);
+
+/**
+ * Reads the most recent trace entries.
+ * @param entries Array to fill, oldest entry first.
+ * @param max Number of entries in the array.
+ * @return Number of entries filled.
+ */
+size_t heap_trace_read(heap_trace_entry *entries, size_t max);
+
 /**
  * Generates a random number.
  * @return A random number.
@@ -108,4 +108,12 @@ int strncmp(const char *s1, const char *s2, size_t max);
  */
 size_t strlen(const char *str);
 
+/**
+ * Finds the first occurence of a substring.
+ * @param str The string to search.
+ * @param sub The substring to find.
+ * @return A pointer to the substring in str, or NULL if not found.
+ */
+char *strstr(const char *str, const char *sub);
+
 #endif
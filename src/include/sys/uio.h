@@ -0,0 +1,23 @@
+/**
+ * @file include/sys/uio.h
+ * Implementation of the C vector I/O definitions.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INCLUDE_SYS_UIO_H_
+#define __INCLUDE_SYS_UIO_H_
+
+#include <sys/types.h>
+
+//! Maximum number of iovec structures in one call.
+#define IOV_MAX 1024
+
+/**
+ * Buffer for scatter/gather I/O.
+ */
+struct iovec{
+	void *iov_base;    //!< Base address of the buffer.
+	size_t iov_len;    //!< Size of the buffer in bytes.
+};
+
+#endif /* __INCLUDE_SYS_UIO_H_ */
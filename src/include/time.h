@@ -23,7 +23,7 @@ typedef struct tm {
 
 #ifndef NULL
 	//! Null pointer constant.
-	#define NULL ((void*)NULL)
+	#define NULL ((void*)0)
 #endif
 
 //! A number used to convert the value returned by clock() into seconds.
@@ -53,5 +53,36 @@ enum {
 //! Flag indicating time is absolute.
 #define TIMER_ABSTIME (0)
 
+/**
+ * Gets the time of a clock.
+ * @param clock_id CLOCK_REALTIME or CLOCK_MONOTONIC.
+ * @param tp Structure to fill with the time.
+ * @return Error code, or EOK if successful.
+ */
+int clock_gettime(clockid_t clock_id, struct timespec *tp);
+
+/**
+ * Gets the current calendar time.
+ * @param tloc Location to also store the time, or NULL.
+ * @return Seconds since the Unix epoch.
+ */
+time_t time(time_t *tloc);
+
+/**
+ * Converts a broken down UTC time to calendar time.
+ * Out of range fields are normalized and tm_wday and tm_yday are set.
+ * @param timeptr The broken down time.
+ * @return Seconds since the Unix epoch, or (time_t)-1 if before the epoch.
+ */
+time_t mktime(struct tm *timeptr);
+
+/**
+ * Converts calendar time to a broken down UTC time.
+ * @param timer Seconds since the Unix epoch.
+ * @param result Structure to fill.
+ * @return result.
+ */
+struct tm *gmtime_r(const time_t *timer, struct tm *result);
+
 #endif /* __INCLUDE_TIME_H_ */
 
@@ -11,25 +11,34 @@
 #include <errno.h>
 #include <kernel/int.h>
 #include <kernel/panic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "dev/bda.h"
+#include "dev/com.h"
 #include "dev/keyboard.h"
 #include "dev/mouse.h"
-#include "dev/pit.h"
 #include "dev/ram.h"
 #include "dev/rtc.h"
 #include "dev/vga.h"
 #include "hal/acpi.h"
 #include "hal/console.h"
+#include "sys/arena.h"
+#include "sys/clock.h"
+#include "sys/frame.h"
+#include "sys/fpu.h"
+#include "sys/interrupt/apic.h"
 #include "sys/interrupt/dt.h"
 #include "sys/paging.h"
 #include "sys/syscall.h"
+#include "sys/thread.h"
 #include "tools/cpuid/cpuid.h"
 #include "tools/date/date.h"
+#include "tools/heapinfo/heapinfo.h"
 #include "tools/memmap/memmap.h"
 #include "tools/pciscan/pciscan.h"
+#include "tools/tlbbench/tlbbench.h"
 #include <fcntl.h>
 
 static const char *const OS_NAME     = "ConlanOS";  //!< Operating System name string.
@@ -38,10 +47,34 @@ static const char *const OS_CODENAME = "Antares";   //!< Operating System code n
 static const char *const OS_REVISION = REVISION;    //!< Operating System source revision.   
 
 //! List of available commands.
-static const char *const commands = "cpuid  date  memmap  pciscan  rand  shutdown\n";
+static const char *const commands = "cpuid  date  heap  heaptrace  memmap  pciscan  rand  shutdown  tlbbench\n";
 
 extern uint32_t kend;                       //!< End of space used by the kernel.
 #define KERNEL_SPACE ((void*)0x00200000)    //!< Maximum address allocated to the kernel.
+#define KERNEL_HEAP_FRAMES 1024             //!< Number of page frames given to the heap.
+#define CONSOLE_HISTORY    10000            //!< Number of rows kept in the console scrollback.
+#define SHELL_LINE 100                      //!< Longest shell command.
+
+/**
+ * Checks if an option was given on the kernel command line.
+ * @param cmdline The kernel command line.
+ * @param option The option to look for.
+ * @return true if option appears as a whole word.
+ */
+static bool kernel_option(const char *cmdline, const char *option){
+	if(cmdline == NULL){
+		return false;
+	}
+	size_t len = strlen(option);
+	for(const char *found = strstr(cmdline, option); found != NULL; found = strstr(found + 1, option)){
+		bool start = (found == cmdline || found[-1] == ' ');
+		bool end = (found[len] == '\0' || found[len] == ' ');
+		if(start && end){
+			return true;
+		}
+	}
+	return false;
+}
 
 /**
  * Main C function for the kernel.
@@ -66,9 +99,14 @@ int kmain(const struct multiboot_info *const mbd, unsigned int magic){
 	}
 	
 	char *cmdline = (char*)mbd->cmdline;
+	if(kernel_option(cmdline, "serial") && com_open(1, COM_BAUD_MAX, 8, 1, COM_PARITY_NONE)){
+		// Copy everything from here on to COM1.
+		console_mirror(&com_desc[0]);
+	}
 	printf("\e[34m%s\e[0m\n", cmdline);
 	
 	paging_init();
+	fpu_init();
 	// Setup descriptor tables.
 	puts("Initializing Descriptor Tables\n");
 	descriptor_tables_init();
@@ -84,52 +122,76 @@ int kmain(const struct multiboot_info *const mbd, unsigned int magic){
 	
 	// Scan memory map.
 	ram_init((struct mmap_entry*)mbd->mmap_addr, mbd->mmap_length, end_kernel);
+	if(frame_init() != EOK){
+		panic("No memory for frame allocator");
+	}
+	if(!kernel_option(cmdline, "nolargepages") && paging_map_ram() != EOK){
+		// Pages that were not mapped are still mapped on demand when faulted.
+		puts("\e[33mFailed to map RAM, mapping on demand\e[0m\n");
+	}
 	
-	// Set the interval timer to 10,000Hz.
-	pit_init(10000);
-	rtc_init();
+	// Give the heap a block of physical memory.
+	uint8_t *heap_start = frame_alloc_contig(KERNEL_HEAP_FRAMES);
+	uint8_t *heap_end = heap_start + KERNEL_HEAP_FRAMES*FRAME_SIZE;
+	if(heap_start == NULL || heap_init((void*[]){heap_start, 0}, (void*[]){heap_end, 0}) != EOK){
+		panic("No memory for heap");
+	}
 	
-	// Initialize the mouse and keyboard.
+	console_init(CONSOLE_HISTORY);
+	
+	// Initialize the mouse, keyboard and serial ports.
 	keyboard_init();
 	mouse_init();
+	com_init();
 	
 	// Enable interrupts.
 	sti();
 	
 	acpi_init();
+	if(kernel_option(cmdline, "noapic") || apic_init() != EOK){
+		puts("Using legacy PIC\n");
+	}
+	// Start the clock, the PIT ticks only if there is no APIC timer.
+	clock_init();
+	rtc_init();
+	// The shell carries on as the boot thread.
+	if(thread_init() != EOK){
+		puts("No memory for threads\n");
+	}
 	
 	char *boot_loader_name = (char*)mbd->boot_loader_name;
 	printf("\e[31m%s\n", boot_loader_name);
 	printf("\e[32m%s %s-%s %s\e[0m\n", OS_NAME, OS_VERSION, OS_REVISION, OS_CODENAME);
 	
 	
-	// heap_init((void*[]){end_kernel, 0}, (void*[]){end_kernel + 536870912, 0});
-	// for(int i = 0; i < 3; ++i){
-		// int size = rand()%1024;
-		// if(size < 0){
-			// size = -size;
-		// }
-		// int *ptr = (int*)malloc(size);
-		// printf("%d bytes @ 0x%x\n", size, ptr);
-	// }
-	
 	memmap_print();
 	
 	set_constraint_handler_s(abort_handler_s);
 	
 	// Begin interactive shell.
 	puts("Beginning Shell\n");
-	char str[100];
+	// Scratch memory for each command, freed when the command finishes.
+	arena *shell = arena_create();
+	if(shell == NULL){
+		panic("No memory for shell");
+	}
 	while(1){
+		arena_mark mark = arena_checkpoint(shell);
+		char *str = arena_alloc(shell, SHELL_LINE);
 		puts("\e[0m> ");
+		fflush(stdout);
 		console_desc.flush();
-		gets_s(str, sizeof(str));
+		gets_s(str, SHELL_LINE);
 		if(!strcmp(str, "cmd")){
 			puts(commands);
 		}else if(!strcmp(str, "cpuid")){
 			cpuid_run();
 		}else if(!strcmp(str, "date")){
 			date_print();
+		}else if(!strcmp(str, "heap")){
+			heapinfo_print();
+		}else if(!strcmp(str, "heaptrace")){
+			heapinfo_trace();
 		}else if(!strcmp(str, "memmap")){
 			memmap_print();
 		}else if(!strcmp(str, "pciscan")){
@@ -139,12 +201,16 @@ int kmain(const struct multiboot_info *const mbd, unsigned int magic){
 			putchar('\n');
 		}else if(!strcmp(str, "shutdown")){
 			break;
+		}else if(!strcmp(str, "tlbbench")){
+			tlbbench_run();
 		}else if(strcmp(str, "")){
 			perror("\e[31;40mUnkown Command: ");
 			perror(str);
 			perror("\e[0m\n");
 		}
+		arena_rollback(shell, mark);
 	}
+	arena_release(shell);
 	
 	acpi_shutdown();
 	
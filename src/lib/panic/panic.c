@@ -18,6 +18,8 @@
  */
 void __panic_actual(const char *msg, const char *file, uint32_t line, const char *func){
 	printf("\n\e[31mKernel Panic: %s:%u: %s: %s\n", file, line, func, msg);
+	fflush(NULL);
+	stdout->dev->flush();
 	
 	asm volatile(
 		"hlt;"
@@ -0,0 +1,144 @@
+/**
+ * @file lib/ring/ring.c
+ * Lock-free single-producer single-consumer ring buffer.
+ *
+ * Each side loads the other side's counter with acquire ordering and
+ * publishes its own with release ordering.  The producer's element copies
+ * are therefore visible before the new head, and the consumer is done
+ * reading a slot before the new tail lets the producer reuse it.  On x86
+ * these compile to plain moves which the compiler may not reorder.
+ * @author Conlan Wesson
+ */
+
+#include "ring.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initializes a ring.
+ * @param r The ring to initialize.
+ * @param data Storage for capacity elements of elem_size bytes.
+ * @param capacity Number of elements, must be a power of two.
+ * @param elem_size Size of each element in bytes.
+ * @return Error code, or EOK if successful.
+ */
+int ring_init(ring *r, void *data, uint32_t capacity, size_t elem_size){
+	if(capacity == 0 || (capacity & (capacity - 1)) || elem_size == 0){
+		return EINVAL;
+	}
+	if(data == NULL){
+		return EFAULT;
+	}
+	r->data = data;
+	r->elem_size = elem_size;
+	r->mask = capacity - 1;
+	r->head = 0;
+	r->tail = 0;
+	return EOK;
+}
+
+/**
+ * Copies elements into the ring storage, wrapping at the end.
+ * @param r The ring.
+ * @param index Free-running index of the first slot.
+ * @param elems The elements to copy in.
+ * @param count Number of elements.
+ */
+static void ring_store(ring *r, uint32_t index, const void *elems, uint32_t count){
+	uint32_t start = index & r->mask;
+	uint32_t first = r->mask + 1 - start;
+	if(first > count){
+		first = count;
+	}
+	memcpy(r->data + start*r->elem_size, elems, first*r->elem_size);
+	memcpy(r->data, (const uint8_t*)elems + first*r->elem_size, (count - first)*r->elem_size);
+}
+
+/**
+ * Copies elements out of the ring storage, wrapping at the end.
+ * @param r The ring.
+ * @param index Free-running index of the first slot.
+ * @param elems Where to copy the elements.
+ * @param count Number of elements.
+ */
+static void ring_load(const ring *r, uint32_t index, void *elems, uint32_t count){
+	uint32_t start = index & r->mask;
+	uint32_t first = r->mask + 1 - start;
+	if(first > count){
+		first = count;
+	}
+	memcpy(elems, r->data + start*r->elem_size, first*r->elem_size);
+	memcpy((uint8_t*)elems + first*r->elem_size, r->data, (count - first)*r->elem_size);
+}
+
+/**
+ * Adds as many elements as fit, called only by the producer.
+ * @param r The ring.
+ * @param elems The elements to copy in.
+ * @param count Number of elements.
+ * @return Number of elements added.
+ */
+uint32_t ring_push_bulk(ring *r, const void *elems, uint32_t count){
+	uint32_t head = r->head;
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	uint32_t space = r->mask + 1 - (head - tail);
+	if(count > space){
+		count = space;
+	}
+	if(count){
+		ring_store(r, head, elems, count);
+		__atomic_store_n(&r->head, head + count, __ATOMIC_RELEASE);
+	}
+	return count;
+}
+
+/**
+ * Removes as many elements as are waiting, called only by the consumer.
+ * @param r The ring.
+ * @param elems Where to copy the elements.
+ * @param count Maximum number of elements.
+ * @return Number of elements removed.
+ */
+uint32_t ring_pop_bulk(ring *r, void *elems, uint32_t count){
+	uint32_t tail = r->tail;
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	if(count > head - tail){
+		count = head - tail;
+	}
+	if(count){
+		ring_load(r, tail, elems, count);
+		__atomic_store_n(&r->tail, tail + count, __ATOMIC_RELEASE);
+	}
+	return count;
+}
+
+/**
+ * Adds an element to the ring, called only by the producer.
+ * @param r The ring.
+ * @param elem The element to copy in.
+ * @return true if the element was added, false if the ring is full.
+ */
+bool ring_push(ring *r, const void *elem){
+	return ring_push_bulk(r, elem, 1) == 1;
+}
+
+/**
+ * Removes an element from the ring, called only by the consumer.
+ * @param r The ring.
+ * @param elem Where to copy the element.
+ * @return true if an element was removed, false if the ring is empty.
+ */
+bool ring_pop(ring *r, void *elem){
+	return ring_pop_bulk(r, elem, 1) == 1;
+}
+
+/**
+ * Discards every waiting element, called only by the consumer.
+ * @param r The ring.
+ */
+void ring_clear(ring *r){
+	__atomic_store_n(&r->tail, __atomic_load_n(&r->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,435 @@
+/**
+ * @file lib/std/heap.c
+ * Heap region management.
+ *
+ * Each heap region starts with a heap_region header and a bitmap of the
+ * slab slots in the region, followed by a list of blocks.  Every block has a
+ * boundary tag holding its size and used flag at both ends, so neighbours
+ * are found and merged in constant time.  Each region is bracketed by used
+ * tags of size 0, so merging never runs off either end.
+ *
+ * Free blocks are kept in segregated lists, one bin per power of two size,
+ * with a bitmap of the bins that are not empty.
+ * @author Conlan Wesson
+ */
+
+#include "heap.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint32_t HEAP_T;    //!< Integer type used for boundary tags.
+
+enum {
+	HEAP_TAG        = sizeof(HEAP_T),    //!< Size of a boundary tag.
+	HEAP_ALIGN      = 8,                 //!< Alignment of all heap allocations.
+	HEAP_MIN_BLOCK  = 16,                //!< Smallest block, room for both tags and the free links.
+	HEAP_BINS       = 32,                //!< Number of free list bins, one per power of two.
+	HEAP_SLAB_SHIFT = 14,                //!< log2(HEAP_SLAB_SIZE).
+	HEAP_MAP_BITS   = 32                 //!< Number of bits per slab map word.
+};
+
+#define HEAP_BLOCK_USED ((HEAP_T)0x1)            //!< Block used flag, sizes are multiples of HEAP_ALIGN.
+#define HEAP_SIZE_MAX   ((size_t)0x7FFFFFF0)     //!< Largest request the heap will try.
+
+/**
+ * Layout of a free block.
+ */
+typedef struct heap_block{
+	HEAP_T tag;                  //!< Size and flags.
+	struct heap_block *next;     //!< Next free block in the same bin.
+	struct heap_block *prev;     //!< Previous free block in the same bin.
+} heap_block;
+
+/**
+ * Header at the start of each heap region.
+ */
+typedef struct heap_region{
+	struct heap_region *next;    //!< Next heap region.
+	HEAP_T *first;               //!< First block in the region.
+	HEAP_T *end;                 //!< End of the region.
+	uint32_t slab_base;          //!< First slab aligned address in the region.
+	uint32_t slabs;              //!< Number of slab slots in the region.
+	uint32_t slab_map[];         //!< Bits set for slab slots holding a slab.
+} heap_region;
+
+static heap_region *heap = NULL;             //!< First heap region.
+static heap_block *heap_bins[HEAP_BINS];     //!< Free lists, bin n holds sizes [2^n, 2^(n+1)).
+static uint32_t heap_bin_map = 0;            //!< Bits set for non-empty bins.
+static size_t heap_free_bytes = 0;           //!< Bytes in free blocks, including tags.
+
+/**
+ * Gets the size of a block.
+ * @param block The block.
+ * @return Size of the block in bytes, including tags.
+ */
+static inline uint32_t heap_block_size(const heap_block *block){
+	return block->tag & ~HEAP_BLOCK_USED;
+}
+
+/**
+ * Gets the block after a block.
+ * @param block The block.
+ * @return The next block.
+ */
+static inline heap_block *heap_block_next(heap_block *block){
+	return (heap_block*)((uint8_t*)block + heap_block_size(block));
+}
+
+/**
+ * Writes both boundary tags of a block.
+ * @param block The block.
+ * @param size Size of the block in bytes.
+ * @param used true if the block is allocated.
+ */
+static inline void heap_block_tag(heap_block *block, uint32_t size, bool used){
+	HEAP_T tag = size | (used ? HEAP_BLOCK_USED : 0);
+	block->tag = tag;
+	*(HEAP_T*)((uint8_t*)block + size - HEAP_TAG) = tag;
+}
+
+/**
+ * Finds the bin for a block size.
+ * @param size Size of the block in bytes.
+ * @return The bin index.
+ */
+static inline uint32_t heap_bin(uint32_t size){
+	return 31 - __builtin_clz(size);
+}
+
+/**
+ * Adds a free block to its bin.
+ * @param block The block.
+ */
+static void heap_bin_insert(heap_block *block){
+	uint32_t bin = heap_bin(heap_block_size(block));
+	block->prev = NULL;
+	block->next = heap_bins[bin];
+	if(block->next){
+		block->next->prev = block;
+	}
+	heap_bins[bin] = block;
+	heap_bin_map |= 1u << bin;
+	heap_free_bytes += heap_block_size(block);
+}
+
+/**
+ * Removes a free block from its bin.
+ * @param block The block.
+ */
+static void heap_bin_remove(heap_block *block){
+	uint32_t bin = heap_bin(heap_block_size(block));
+	if(block->prev){
+		block->prev->next = block->next;
+	}else{
+		heap_bins[bin] = block->next;
+		if(heap_bins[bin] == NULL){
+			heap_bin_map &= ~(1u << bin);
+		}
+	}
+	if(block->next){
+		block->next->prev = block->prev;
+	}
+	heap_free_bytes -= heap_block_size(block);
+}
+
+/**
+ * Finds a free block of at least the given size.
+ * The request's own bin is searched first fit, otherwise any block from a
+ * larger bin is big enough.
+ * @param size Size of the block in bytes.
+ * @return A free block, or NULL if none is large enough.
+ */
+static heap_block *heap_bin_find(uint32_t size){
+	uint32_t bin = heap_bin(size);
+	for(heap_block *block = heap_bins[bin]; block; block = block->next){
+		if(heap_block_size(block) >= size){
+			return block;
+		}
+	}
+	uint32_t above = (bin < HEAP_BINS - 1) ? heap_bin_map & ~((2u << bin) - 1) : 0;
+	if(above == 0){
+		return NULL;
+	}
+	return heap_bins[__builtin_ctz(above)];
+}
+
+/**
+ * Frees the end of a block beyond the given size.
+ * Nothing is split if the remainder is too small to be a block.
+ * @param block The block, not in any bin.
+ * @param size Size of the block in bytes.
+ * @param keep Number of bytes to keep.
+ * @return The new size of the block.
+ */
+static uint32_t heap_block_trim(heap_block *block, uint32_t size, uint32_t keep){
+	if(size - keep < HEAP_MIN_BLOCK){
+		return size;
+	}
+	heap_block *rest = (heap_block*)((uint8_t*)block + keep);
+	uint32_t rest_size = size - keep;
+	heap_block *next = (heap_block*)((uint8_t*)block + size);
+	if(!(next->tag & HEAP_BLOCK_USED)){
+		heap_bin_remove(next);
+		rest_size += heap_block_size(next);
+	}
+	heap_block_tag(rest, rest_size, false);
+	heap_bin_insert(rest);
+	return keep;
+}
+
+/**
+ * Rounds a request up to a block size.
+ * @param size Number of bytes requested.
+ * @return Size of the block in bytes, including tags.
+ */
+static inline uint32_t heap_block_round(size_t size){
+	uint32_t need = (size + 2*HEAP_TAG + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+	return (need < HEAP_MIN_BLOCK) ? HEAP_MIN_BLOCK : need;
+}
+
+/**
+ * Finds the region containing a pointer.
+ * @param ptr The pointer.
+ * @return The region, or NULL if ptr is not in the heap.
+ */
+static heap_region *heap_find(const void *ptr){
+	for(heap_region *region = heap; region; region = region->next){
+		if((const HEAP_T*)ptr >= region->first && (const HEAP_T*)ptr < region->end){
+			return region;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Initializes the heap.
+ * @param start Null terminated array of pointers to the start of heap spaces.
+ * @param end Null terminated array of pointers to the end of heap spaces.
+ * @return Error code, or EOK if successful.
+ */
+int heap_init(void *start[], void *end[]){
+	// Do not reinitialize the heap!
+	if(heap != NULL){
+		return ECANCELED;
+	}
+	
+	heap_region **link = &heap;
+	for(int i = 0; start[i] && end[i]; ++i){
+		uint32_t base = ((uint32_t)start[i] + HEAP_TAG - 1) & ~(HEAP_TAG - 1);
+		uint32_t last = (uint32_t)end[i] & ~(HEAP_ALIGN - 1);
+		if(last <= base + sizeof(heap_region)){
+			continue;
+		}
+		
+		// Size the slab map for the whole region.
+		heap_region *region = (heap_region*)base;
+		region->slab_base = (base + HEAP_SLAB_SIZE - 1) & ~(HEAP_SLAB_SIZE - 1);
+		region->slabs = (last > region->slab_base) ? (last - region->slab_base) >> HEAP_SLAB_SHIFT : 0;
+		uint32_t words = (region->slabs + HEAP_MAP_BITS - 1) / HEAP_MAP_BITS;
+		
+		// Blocks start after a prologue tag, with their data aligned.
+		uint32_t first = (uint32_t)&region->slab_map[words] + 2*HEAP_TAG;
+		first = ((first + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1)) - HEAP_TAG;
+		if(last < first + HEAP_MIN_BLOCK + HEAP_TAG){
+			continue;
+		}
+		for(uint32_t w = 0; w < words; ++w){
+			region->slab_map[w] = 0;
+		}
+		region->first = (HEAP_T*)first;
+		region->end = (HEAP_T*)last;
+		region->first[-1] = HEAP_BLOCK_USED;    // Prologue.
+		region->end[-1] = HEAP_BLOCK_USED;      // Epilogue.
+		
+		// The whole region starts as one free block.
+		heap_block *block = (heap_block*)first;
+		heap_block_tag(block, last - HEAP_TAG - first, false);
+		heap_bin_insert(block);
+		
+		region->next = NULL;
+		*link = region;
+		link = &region->next;
+	}
+	
+	return (heap != NULL) ? EOK : ENOMEM;
+}
+
+/**
+ * Allocates a block from the heap regions.
+ * @param size Number of bytes to allocate.
+ * @param align Alignment of the block, a power of two.
+ * @return Pointer to the allocated space, or NULL if no block is large enough.
+ */
+void *heap_alloc(size_t size, size_t align){
+	if(size > HEAP_SIZE_MAX || align > HEAP_SIZE_MAX){
+		return NULL;
+	}
+	if(align < HEAP_ALIGN){
+		align = HEAP_ALIGN;
+	}
+	uint32_t need = heap_block_round(size);
+	uint32_t want = need;
+	if(align > HEAP_ALIGN){
+		// Room to split off padding in front of an aligned block.
+		want += align + HEAP_MIN_BLOCK;
+	}
+	
+	heap_block *block = heap_bin_find(want);
+	if(block == NULL){
+		return NULL;
+	}
+	heap_bin_remove(block);
+	uint32_t block_size = heap_block_size(block);
+	
+	uint32_t data = (uint32_t)block + HEAP_TAG;
+	uint32_t aligned = (data + align - 1) & ~(align - 1);
+	while(aligned != data && aligned - data < HEAP_MIN_BLOCK){
+		aligned += align;
+	}
+	if(aligned != data){
+		// Leave the padding as a free block.
+		uint32_t pad = aligned - data;
+		heap_block_tag(block, pad, false);
+		heap_bin_insert(block);
+		block = (heap_block*)((uint8_t*)block + pad);
+		block_size -= pad;
+	}
+	
+	block_size = heap_block_trim(block, block_size, need);
+	heap_block_tag(block, block_size, true);
+	return (void*)aligned;
+}
+
+/**
+ * Returns a block to the heap regions.
+ * @param ptr Pointer returned by heap_alloc().
+ */
+void heap_free(void *ptr){
+	heap_block *block = (heap_block*)((uint8_t*)ptr - HEAP_TAG);
+	if(!(block->tag & HEAP_BLOCK_USED)){
+		return;
+	}
+	uint32_t size = heap_block_size(block);
+	
+	// Merge with the next block if it is free.
+	heap_block *next = heap_block_next(block);
+	if(!(next->tag & HEAP_BLOCK_USED)){
+		heap_bin_remove(next);
+		size += heap_block_size(next);
+	}
+	
+	// Merge with the previous block if it is free.
+	HEAP_T prev_tag = *((HEAP_T*)block - 1);
+	if(!(prev_tag & HEAP_BLOCK_USED)){
+		heap_block *prev = (heap_block*)((uint8_t*)block - prev_tag);
+		heap_bin_remove(prev);
+		size += prev_tag;
+		block = prev;
+	}
+	
+	heap_block_tag(block, size, false);
+	heap_bin_insert(block);
+}
+
+/**
+ * Resizes a block without moving it.
+ * @param ptr Pointer returned by heap_alloc().
+ * @param size New number of bytes.
+ * @return true if the block now holds size bytes, false if it must move.
+ */
+bool heap_resize(void *ptr, size_t size){
+	if(size > HEAP_SIZE_MAX){
+		return false;
+	}
+	heap_block *block = (heap_block*)((uint8_t*)ptr - HEAP_TAG);
+	uint32_t block_size = heap_block_size(block);
+	uint32_t need = heap_block_round(size);
+	
+	if(need > block_size){
+		// Grow into the next block if it is free.
+		heap_block *next = heap_block_next(block);
+		if((next->tag & HEAP_BLOCK_USED) || block_size + heap_block_size(next) < need){
+			return false;
+		}
+		heap_bin_remove(next);
+		block_size += heap_block_size(next);
+	}
+	
+	block_size = heap_block_trim(block, block_size, need);
+	heap_block_tag(block, block_size, true);
+	return true;
+}
+
+/**
+ * Gets the usable size of a block.
+ * @param ptr Pointer returned by heap_alloc().
+ * @return Number of bytes the block can hold.
+ */
+size_t heap_size(const void *ptr){
+	const heap_block *block = (const heap_block*)((const uint8_t*)ptr - HEAP_TAG);
+	return heap_block_size(block) - 2*HEAP_TAG;
+}
+
+/**
+ * Measures the free space in the heap regions.
+ * @param free Set to the number of bytes in free blocks.
+ * @param largest Set to the size of the largest free block.
+ */
+void heap_space(size_t *free, size_t *largest){
+	*free = heap_free_bytes;
+	*largest = 0;
+	if(heap_bin_map){
+		// The largest block is in the highest non-empty bin.
+		for(heap_block *block = heap_bins[31 - __builtin_clz(heap_bin_map)]; block; block = block->next){
+			if(heap_block_size(block) > *largest){
+				*largest = heap_block_size(block);
+			}
+		}
+	}
+}
+
+/**
+ * Allocates a slab from the heap regions.
+ * @return Pointer to HEAP_SLAB_SIZE bytes aligned to HEAP_SLAB_SIZE, or NULL.
+ */
+void *heap_slab_alloc(){
+	void *slab = heap_alloc(HEAP_SLAB_SIZE, HEAP_SLAB_SIZE);
+	if(slab){
+		heap_region *region = heap_find(slab);
+		uint32_t index = ((uint32_t)slab - region->slab_base) >> HEAP_SLAB_SHIFT;
+		region->slab_map[index / HEAP_MAP_BITS] |= 1u << (index % HEAP_MAP_BITS);
+	}
+	return slab;
+}
+
+/**
+ * Returns a slab to the heap regions.
+ * @param slab Pointer returned by heap_slab_alloc().
+ */
+void heap_slab_free(void *slab){
+	heap_region *region = heap_find(slab);
+	if(region == NULL){
+		return;
+	}
+	uint32_t index = ((uint32_t)slab - region->slab_base) >> HEAP_SLAB_SHIFT;
+	region->slab_map[index / HEAP_MAP_BITS] &= ~(1u << (index % HEAP_MAP_BITS));
+	heap_free(slab);
+}
+
+/**
+ * Checks if a pointer is inside a slab.
+ * @param ptr The pointer to check.
+ * @return true if ptr belongs to a slab, false if it is from heap_alloc().
+ */
+bool heap_is_slab(const void *ptr){
+	heap_region *region = heap_find(ptr);
+	if(region == NULL || (uint32_t)ptr < region->slab_base){
+		return false;
+	}
+	uint32_t index = ((uint32_t)ptr - region->slab_base) >> HEAP_SLAB_SHIFT;
+	return index < region->slabs && ((region->slab_map[index / HEAP_MAP_BITS] >> (index % HEAP_MAP_BITS)) & 1);
+}
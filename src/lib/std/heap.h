@@ -0,0 +1,70 @@
+/**
+ * @file lib/std/heap.h
+ * Internal heap functions.
+ * @author Conlan Wesson
+ */
+
+#ifndef __LIB_STD_HEAP_H_
+#define __LIB_STD_HEAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HEAP_SLAB_SIZE 0x4000u    //!< Size and alignment of a slab.
+
+/**
+ * Allocates a block from the heap regions.
+ * @param size Number of bytes to allocate.
+ * @param align Alignment of the block, a power of two.
+ * @return Pointer to the allocated space, or NULL if no block is large enough.
+ */
+void *heap_alloc(size_t size, size_t align);
+
+/**
+ * Returns a block to the heap regions.
+ * @param ptr Pointer returned by heap_alloc().
+ */
+void heap_free(void *ptr);
+
+/**
+ * Resizes a block without moving it.
+ * @param ptr Pointer returned by heap_alloc().
+ * @param size New number of bytes.
+ * @return true if the block now holds size bytes, false if it must move.
+ */
+bool heap_resize(void *ptr, size_t size);
+
+/**
+ * Gets the usable size of a block.
+ * @param ptr Pointer returned by heap_alloc().
+ * @return Number of bytes the block can hold.
+ */
+size_t heap_size(const void *ptr);
+
+/**
+ * Measures the free space in the heap regions.
+ * @param free Set to the number of bytes in free blocks.
+ * @param largest Set to the size of the largest free block.
+ */
+void heap_space(size_t *free, size_t *largest);
+
+/**
+ * Allocates a slab from the heap regions.
+ * @return Pointer to HEAP_SLAB_SIZE bytes aligned to HEAP_SLAB_SIZE, or NULL.
+ */
+void *heap_slab_alloc();
+
+/**
+ * Returns a slab to the heap regions.
+ * @param slab Pointer returned by heap_slab_alloc().
+ */
+void heap_slab_free(void *slab);
+
+/**
+ * Checks if a pointer is inside a slab.
+ * @param ptr The pointer to check.
+ * @return true if ptr belongs to a slab, false if it is from heap_alloc().
+ */
+bool heap_is_slab(const void *ptr);
+
+#endif
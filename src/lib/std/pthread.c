@@ -7,11 +7,48 @@
 #include <pthread.h>
 
 #include <errno.h>
+#include <kernel/int.h>
 #include <stddef.h>
+#include "sys/thread.h"
+
+int pthread_attr_init(pthread_attr_t* attr){
+	if(attr == NULL){
+		return EINVAL;
+	}
+	attr->prio = THREAD_PRIO_DEFAULT;
+	return EOK;
+}
+
+int pthread_create(pthread_t* out, const pthread_attr_t* attr, void *(*start_routine)(void*), void* arg){
+	int prio = (attr != NULL) ? attr->prio : THREAD_PRIO_DEFAULT;
+	if(prio <= THREAD_PRIO_IDLE || prio > THREAD_PRIO_MAX){
+		return EINVAL;
+	}
+	return thread_create(out, start_routine, arg, prio);
+}
+
+int pthread_join(pthread_t t, void** value_ptr){
+	return thread_join(t, value_ptr);
+}
+
+int pthread_yield(){
+	thread_yield();
+	return EOK;
+}
+
+pthread_t pthread_self(){
+	return thread_self();
+}
+
+void pthread_exit(void* value_ptr){
+	thread_exit(value_ptr);
+}
 
 int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr){
 	mutex->lock = 0;
 	mutex->count = 1;
+	mutex->waiters.head = NULL;
+	mutex->waiters.tail = NULL;
 	if(attr != NULL){
 		mutex->attr.prio = attr->prio;
 		mutex->attr.protocol = attr->protocol;
@@ -50,12 +87,17 @@ int pthread_mutex_trylock(pthread_mutex_t* mutex){
 }
 
 int pthread_mutex_lock(pthread_mutex_t* mutex){
+	// No unlock can come between the failed try and the wait.
+	uint32_t flags = int_save();
 	while(pthread_mutex_trylock(mutex) == EBUSY){
+		thread_wait(&mutex->waiters);
 	}
+	int_restore(flags);
 	return EOK;
 }
 
 int pthread_mutex_unlock(pthread_mutex_t* mutex){
+	uint32_t flags = int_save();
 	for(;;){
 		if(test_and_set(&mutex->lock)){
 			++mutex->count;
@@ -63,6 +105,11 @@ int pthread_mutex_unlock(pthread_mutex_t* mutex){
 			break;
 		}
 	}
+	if(thread_wake(&mutex->waiters)){
+		// Let a waiter with a higher priority have the mutex now.
+		thread_preempt();
+	}
+	int_restore(flags);
 	return EOK;
 }
 
@@ -0,0 +1,176 @@
+/**
+ * @file lib/std/slab.c
+ * Size class allocator for small objects.
+ *
+ * Small allocations are rounded up to a power of two size class.  Each class
+ * keeps a list of slabs that still have free objects, so allocating and
+ * freeing never search.  A slab is HEAP_SLAB_SIZE aligned, which lets free
+ * find the slab header by masking the object's address.
+ * @author Conlan Wesson
+ */
+
+#include "slab.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "heap.h"
+
+enum {
+	SLAB_MIN_SHIFT = 4,    //!< log2 of the smallest size class.
+	SLAB_CLASSES   = 8     //!< Number of size classes, 16 to SLAB_MAX bytes.
+};
+
+/**
+ * Header at the start of each slab.
+ */
+typedef struct slab{
+	struct slab *next;    //!< Next slab with free objects in the same class.
+	struct slab *prev;    //!< Previous slab with free objects in the same class.
+	void *free;           //!< List of freed objects.
+	uint8_t *fresh;       //!< First object that has never been allocated.
+	uint16_t used;        //!< Number of allocated objects.
+	uint16_t size;        //!< Size of each object.
+	uint8_t cls;          //!< Size class of the slab.
+} slab;
+
+static slab *slab_partial[SLAB_CLASSES];    //!< Slabs with free objects, for each class.
+
+/**
+ * Finds the size class for an allocation.
+ * @param size Number of bytes, at most SLAB_MAX.
+ * @return The size class index.
+ */
+static inline uint32_t slab_class(size_t size){
+	if(size <= (1u << SLAB_MIN_SHIFT)){
+		return 0;
+	}
+	return 32 - __builtin_clz(size - 1) - SLAB_MIN_SHIFT;
+}
+
+/**
+ * Finds the slab containing an object.
+ * @param ptr The object.
+ * @return The slab header.
+ */
+static inline slab *slab_of(const void *ptr){
+	return (slab*)((uint32_t)ptr & ~(HEAP_SLAB_SIZE - 1));
+}
+
+/**
+ * Checks if a slab has no free objects.
+ * @param s The slab.
+ * @return true if every object is allocated.
+ */
+static inline bool slab_full(const slab *s){
+	return s->free == NULL && s->fresh + s->size > (const uint8_t*)s + HEAP_SLAB_SIZE;
+}
+
+/**
+ * Adds a slab to the front of its class's partial list.
+ * @param s The slab.
+ */
+static void slab_link(slab *s){
+	s->prev = NULL;
+	s->next = slab_partial[s->cls];
+	if(s->next){
+		s->next->prev = s;
+	}
+	slab_partial[s->cls] = s;
+}
+
+/**
+ * Removes a slab from its class's partial list.
+ * @param s The slab.
+ */
+static void slab_unlink(slab *s){
+	if(s->prev){
+		s->prev->next = s->next;
+	}else{
+		slab_partial[s->cls] = s->next;
+	}
+	if(s->next){
+		s->next->prev = s->prev;
+	}
+	s->next = NULL;
+	s->prev = NULL;
+}
+
+/**
+ * Allocates an empty slab for a size class.
+ * @param cls The size class.
+ * @return The new slab, or NULL if out of memory.
+ */
+static slab *slab_create(uint32_t cls){
+	slab *s = (slab*)heap_slab_alloc();
+	if(s == NULL){
+		return NULL;
+	}
+	s->size = 1u << (cls + SLAB_MIN_SHIFT);
+	s->cls = cls;
+	s->used = 0;
+	s->free = NULL;
+	// Objects start at the first multiple of their size after the header.
+	s->fresh = (uint8_t*)s + ((sizeof(slab) + s->size - 1) & ~(s->size - 1));
+	slab_link(s);
+	return s;
+}
+
+/**
+ * Allocates a small object.
+ * @param size Number of bytes to allocate, at most SLAB_MAX.
+ * @return Pointer to the allocated space, or NULL if out of memory.
+ */
+void *slab_alloc(size_t size){
+	uint32_t cls = slab_class(size);
+	slab *s = slab_partial[cls];
+	if(s == NULL){
+		s = slab_create(cls);
+		if(s == NULL){
+			return NULL;
+		}
+	}
+	
+	void *obj;
+	if(s->free){
+		obj = s->free;
+		s->free = *(void**)obj;
+	}else{
+		obj = s->fresh;
+		s->fresh += s->size;
+	}
+	++s->used;
+	if(slab_full(s)){
+		slab_unlink(s);
+	}
+	return obj;
+}
+
+/**
+ * Frees a small object.
+ * @param ptr Pointer returned by slab_alloc().
+ */
+void slab_free(void *ptr){
+	slab *s = slab_of(ptr);
+	if(slab_full(s)){
+		slab_link(s);
+	}
+	*(void**)ptr = s->free;
+	s->free = ptr;
+	--s->used;
+	
+	// Keep one empty slab per class so alternating malloc/free does not thrash.
+	if(s->used == 0 && (slab_partial[s->cls] != s || s->next != NULL)){
+		slab_unlink(s);
+		heap_slab_free(s);
+	}
+}
+
+/**
+ * Gets the usable size of a small object.
+ * @param ptr Pointer returned by slab_alloc().
+ * @return Size of the object's size class.
+ */
+size_t slab_size(const void *ptr){
+	return slab_of(ptr)->size;
+}
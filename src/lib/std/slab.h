@@ -0,0 +1,34 @@
+/**
+ * @file lib/std/slab.h
+ * Internal size class allocator functions.
+ * @author Conlan Wesson
+ */
+
+#ifndef __LIB_STD_SLAB_H_
+#define __LIB_STD_SLAB_H_
+
+#include <stddef.h>
+
+#define SLAB_MAX 2048u    //!< Largest allocation served from a slab.
+
+/**
+ * Allocates a small object.
+ * @param size Number of bytes to allocate, at most SLAB_MAX.
+ * @return Pointer to the allocated space, or NULL if out of memory.
+ */
+void *slab_alloc(size_t size);
+
+/**
+ * Frees a small object.
+ * @param ptr Pointer returned by slab_alloc().
+ */
+void slab_free(void *ptr);
+
+/**
+ * Gets the usable size of a small object.
+ * @param ptr Pointer returned by slab_alloc().
+ * @return Size of the object's size class.
+ */
+size_t slab_size(const void *ptr);
+
+#endif
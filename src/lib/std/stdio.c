@@ -8,6 +8,8 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <kernel/div.h>
+#include <kernel/int.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -17,116 +19,353 @@
 #include "dev/keyboard.h"
 #include "constraint.h"
 
-device_descriptor *stdout = &console_desc;
-device_descriptor *stderr = &console_desc;
-device_descriptor *stdin = &console_desc;
+static char stdout_buf[BUFSIZ];    //!< Default buffer for stdout.
+
+//! Standard output, line buffered on the console.
+static FILE stdout_file = {&console_desc, stdout_buf, BUFSIZ, 0, _IOLBF, false};
+//! Standard error, unbuffered on the console.
+static FILE stderr_file = {&console_desc, NULL, 0, 0, _IONBF, false};
+//! Standard input from the console.
+static FILE stdin_file = {&console_desc, NULL, 0, 0, _IONBF, false};
+
+FILE *stdout = &stdout_file;
+FILE *stderr = &stderr_file;
+FILE *stdin = &stdin_file;
 
 /**
- * Writes an integet to stdout.
- * @param num The integer to write.
- * @param base The base to use for the output.
- * @param group_size The number of digits per group.
- * @param digit_sep The digit seperator character.
- * @param group_sep The group seperator character.
- * @param length The minimum length of the output string.
- * @param pad The padding character.
- * @param neg How to handle signs.
- * @param cap true to use capital letters, false otherwise.
- * @param depth Depth of the recursive calls.
- * @param sign true if the original number was negative, false otherwise.
- * @return Number of characters written.
+ * Writes bytes to the device of a stream.
+ * @param stream The stream to write to.
+ * @param str Bytes to write.
+ * @param count Number of bytes.
+ * @return Zero if successful, EOF otherwise.
  */
-static unsigned int __putnum_actual(int num, unsigned int base, unsigned int group_size, char digit_sep, char group_sep, unsigned int length, char pad, enum putnum_sign neg, bool cap, unsigned int depth, bool sign){
-	unsigned int count = 0;
-	if(neg != PUTNUM_SIGN_NONE){
-		if(num < 0){
-			if(neg == PUTNUM_SIGN_NLEAD || neg == PUTNUM_SIGN_PLEAD){
-				putchar('-');
-				++depth;
-				++count;
-			}
-			num = -num;
-			sign = true;
-		}else if(depth == 0 && neg == PUTNUM_SIGN_PLEAD){
-			putchar('+');
-			++depth;
-			++count;
+static int stream_put(FILE *stream, const char *str, size_t count){
+	if(count && device_write(stream->dev, 0, str, count) != (ssize_t)count){
+		stream->error = true;
+		return EOF;
+	}
+	return 0;
+}
+
+/**
+ * Writes bytes to a stream, buffering them according to its mode.
+ * The buffer is filled with interrupts disabled, so a thread switched in
+ * halfway cannot append past its end.  The device is written to with
+ * interrupts enabled.
+ * @param stream The stream to write to.
+ * @param str Bytes to write.
+ * @param count Number of bytes.
+ * @return Zero if successful, EOF otherwise.
+ */
+static int stream_write(FILE *stream, const char *str, size_t count){
+	if(stream->mode == _IONBF || !stream->buf){
+		return stream_put(stream, str, count);
+	}
+	if(count >= stream->size){
+		// Too big to be worth copying.
+		if(fflush(stream)){
+			return EOF;
 		}
+		return stream_put(stream, str, count);
 	}
-	
-	register unsigned int quo = num / base;
-	register unsigned int rem = num % base;
-	
-	if(quo != 0){
-		// Iterate to through the digits.
-		count += __putnum_actual(quo, base, group_size, digit_sep, group_sep, length, pad, neg, cap, depth+1, sign);
-	}else if(pad){
-		if(length <= depth){
-			if(sign){
-				if(neg == PUTNUM_SIGN_NEMBED){
-					putchar('-');
-					++count;
-				}
-			}else{
-				if(neg == PUTNUM_SIGN_PEMBED || neg == PUTNUM_SIGN_NEMBED){
-					putchar('+');
-					++count;
-				}
-			}
+	uint32_t flags = int_save();
+	while(stream->len + count > stream->size){
+		int_restore(flags);
+		if(fflush(stream)){
+			return EOF;
 		}
-		// Print any padding.
-		for(unsigned int i = length; i > depth+1; --i){
-			if(i == depth+2 && sign && (neg == PUTNUM_SIGN_NEMBED || neg == PUTNUM_SIGN_PEMBED)){
-				putchar('-');
-				++count;
-			}else if(i == depth+2 && !sign && neg == PUTNUM_SIGN_PEMBED){
-				putchar('+');
-				++count;
-			}else{
-				putchar(pad);
-				++count;
-				// Print group and digit seperators in padding.
-				if(group_size && group_sep && (i-1) % group_size == 0){
-					putchar(group_sep);
-					++count;
-				}else if(digit_sep){
-					putchar(digit_sep);
-					++count;
-				}
-			}
+		flags = int_save();
+	}
+	memcpy(&stream->buf[stream->len], str, count);
+	stream->len += count;
+	int_restore(flags);
+	if(stream->mode == _IOLBF && memchr(str, '\n', count)){
+		return fflush(stream);
+	}
+	return 0;
+}
+
+/**
+ * Sets the buffering mode of a stream.
+ * Any buffered output is written first.
+ * @param stream The stream to change.
+ * @param buf Buffer to use, or NULL to keep the current buffer.
+ * @param mode One of _IOFBF, _IOLBF or _IONBF.
+ * @param size Size of buf.
+ * @return Zero if successful, non-zero otherwise.
+ */
+int setvbuf(FILE *stream, char *buf, int mode, size_t size){
+	if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF){
+		return EINVAL;
+	}
+	uint32_t flags = int_save();
+	// Other threads may append while the old buffer is written out.
+	while(stream->len){
+		int_restore(flags);
+		if(fflush(stream)){
+			return EIO;
+		}
+		flags = int_save();
+	}
+	int ret = 0;
+	if(buf && size){
+		stream->buf = buf;
+		stream->size = size;
+	}else if(mode != _IONBF && !stream->buf){
+		// Nothing to buffer into.
+		ret = ENOMEM;
+	}
+	if(!ret){
+		stream->mode = mode;
+	}
+	int_restore(flags);
+	return ret;
+}
+
+/**
+ * Writes any buffered output of a stream to its device.
+ * The bytes are taken out of the buffer with interrupts disabled and
+ * written with them enabled, a slow device would otherwise hold off IRQs
+ * for the whole write.
+ * @param stream The stream to flush, or NULL for all streams.
+ * @return Zero if successful, EOF otherwise.
+ */
+int fflush(FILE *stream){
+	if(!stream){
+		int ret = fflush(stdout);
+		return fflush(stderr) ? EOF : ret;
+	}
+	char out[BUFSIZ];
+	int ret;
+	size_t left;
+	do{
+		uint32_t flags = int_save();
+		size_t len = stream->len;
+		if(len > sizeof(out)){
+			len = sizeof(out);
+		}
+		if(len){
+			memcpy(out, stream->buf, len);
+			stream->len -= len;
+			memmove(stream->buf, &stream->buf[len], stream->len);
+		}
+		left = stream->len;
+		int_restore(flags);
+		ret = stream_put(stream, out, len);
+	}while(left && !ret);
+	return ret;
+}
+
+/**
+ * Writes an array of elements to a stream.
+ * @param ptr The elements to write.
+ * @param size Size of each element.
+ * @param nmemb Number of elements.
+ * @param stream The stream to write to.
+ * @return Number of elements written.
+ */
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream){
+	if(!size || !nmemb || nmemb > SIZE_MAX / size){
+		return 0;
+	}
+	if(stream_write(stream, ptr, size*nmemb)){
+		return 0;
+	}
+	return nmemb;
+}
+
+/**
+ * Writes a character to a stream.
+ * @param ch Character to write.
+ * @param stream The stream to write to.
+ * @return ch if successful, EOF otherwise.
+ */
+int fputc(int ch, FILE *stream){
+	char c = ch;
+	if(stream_write(stream, &c, 1)){
+		return EOF;
+	}
+	return (unsigned char)c;
+}
+
+/**
+ * Writes a string to a stream.
+ * @param str String to write.
+ * @param stream The stream to write to.
+ * @return Non-negative if successful, EOF otherwise.
+ */
+int fputs(const char *str, FILE *stream){
+	size_t max = strlen(str);
+	if(stream_write(stream, str, max)){
+		return EOF;
+	}
+	return max;
+}
+
+enum {
+	FORMAT_MAX = 256    //!< Longest formatted integer, including padding.
+};
+
+/**
+ * How to format an integer.
+ */
+typedef struct format_spec{
+	unsigned int width;         //!< Minimum length of the output.
+	int precision;              //!< Minimum number of digits, negative for the default.
+	char pad;                   //!< Padding character, zero for no padding.
+	enum putnum_sign sign;      //!< How to display the sign.
+	bool left;                  //!< Pad with spaces on the right instead.
+	bool cap;                   //!< Use capital letters.
+	unsigned int group_size;    //!< Number of digits per group.
+	char digit_sep;             //!< Digit seperator character.
+	char group_sep;             //!< Group seperator character.
+	const char *prefix;         //!< Radix prefix printed after the sign, or NULL.
+} format_spec;
+
+//! Every pair of decimal digits, from "00" to "99".
+static const char format_pairs[200] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+//! Digit characters for bases up to 36.
+static const char format_lower[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+//! Capital digit characters for bases up to 36.
+static const char format_upper[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/**
+ * Writes the decimal digits of a 32bit number backwards.
+ * @param end Position after the last digit.
+ * @param num The number to write.
+ * @param full Write all 9 digits of a chunk, with leading zeros.
+ * @return Position of the first digit.
+ */
+static char *format_dec32(char *end, uint32_t num, bool full){
+	char *pos = end;
+	while(num >= 100){
+		uint32_t pair = num % 100;
+		num /= 100;
+		pos -= 2;
+		memcpy(pos, &format_pairs[pair*2], 2);
+	}
+	if(num >= 10){
+		pos -= 2;
+		memcpy(pos, &format_pairs[num*2], 2);
+	}else{
+		*--pos = '0' + num;
+	}
+	while(full && end - pos < 9){
+		*--pos = '0';
+	}
+	return pos;
+}
+
+/**
+ * Writes the digits of a number backwards.
+ * @param end Position after the last digit.
+ * @param num The number to write.
+ * @param base The base to use, bases over 36 print each digit in decimal.
+ * @param cap true to use capital letters, false otherwise.
+ * @return Position of the first digit.
+ */
+static char *format_digits(char *end, uint64_t num, unsigned int base, bool cap){
+	const char *digits = cap ? format_upper : format_lower;
+	char *pos = end;
+	if(base == 10){
+		// Nine digits at a time, then two at a time within each chunk.
+		while(num >= 1000000000ull){
+			pos = format_dec32(pos, div64_32(&num, 1000000000u), true);
 		}
+		pos = format_dec32(pos, (uint32_t)num, false);
+	}else if((base & (base - 1)) == 0){
+		unsigned int shift = __builtin_ctz(base);
+		do{
+			*--pos = digits[(uint32_t)num & (base - 1)];
+			num >>= shift;
+		}while(num);
+	}else if(base <= 36){
+		do{
+			*--pos = digits[div64_32(&num, base)];
+		}while(num);
+	}else{
+		do{
+			pos = format_dec32(pos, div64_32(&num, base), false);
+		}while(num);
+	}
+	return pos;
+}
+
+/**
+ * Formats an integer into a buffer.
+ * Precision is limited to FORMAT_MAX/4 digits and width to FORMAT_MAX.
+ * @param buf Buffer of FORMAT_MAX characters, the output starts at buf[0].
+ * @param num The magnitude of the integer.
+ * @param negative true if the integer is negative.
+ * @param base The base to use for the output.
+ * @param spec How to format the integer.
+ * @return Number of characters in the buffer.
+ */
+static size_t format_int(char *buf, uint64_t num, bool negative, unsigned int base, const format_spec *spec){
+	char digits[FORMAT_MAX];
+	char *end = digits + sizeof(digits);
+	char *pos = end;
+	if(num || spec->precision != 0){
+		pos = format_digits(end, num, base, spec->cap);
+	}
+	while(end - pos < spec->precision && end - pos < FORMAT_MAX/4){
+		*--pos = '0';
 	}
 	
-	// Print the current digit.
-	if(base < 36){
-		if(rem < 10){
-			putchar(rem + '0');
-			++count;
-		}else{
-			if(cap){
-				putchar(rem - 10 + 'A');
-				++count;
-			}else{
-				putchar(rem - 10 + 'a');
-				++count;
+	// Build the output backwards from the end of the buffer.
+	char *out = buf + FORMAT_MAX;
+	size_t count = end - pos;
+	if((spec->digit_sep || spec->group_sep) && count > 1){
+		for(size_t i = 0; i < count; ++i){
+			if(i){
+				if(spec->group_size && spec->group_sep && i % spec->group_size == 0){
+					*--out = spec->group_sep;
+				}else if(spec->digit_sep){
+					*--out = spec->digit_sep;
+				}
 			}
+			*--out = end[-1 - (int)i];
 		}
 	}else{
-		// Any base over 36 is printed in decimal.
-		count += __putnum_actual(rem, 10, 0, 0, 0, 0, 0, PUTNUM_SIGN_NONE, cap, 0, sign);
+		out -= count;
+		memcpy(out, pos, count);
 	}
 	
-	// Print group and digit seperators.
-	if(depth){
-		if(group_size && group_sep && depth % group_size == 0){
-			putchar(group_sep);
-			++count;
-		}else if(digit_sep){
-			putchar(digit_sep);
-			++count;
-		}
+	char sign = 0;
+	if(negative && spec->sign != PUTNUM_SIGN_NONE){
+		sign = '-';
+	}else if(spec->sign == PUTNUM_SIGN_PLEAD || spec->sign == PUTNUM_SIGN_PEMBED){
+		sign = '+';
+	}
+	size_t prefix = spec->prefix ? strlen(spec->prefix) : 0;
+	size_t used = (buf + FORMAT_MAX - out) + (sign ? 1 : 0) + prefix;
+	size_t width = spec->width < FORMAT_MAX ? spec->width : FORMAT_MAX;
+	size_t padding = (spec->pad && !spec->left && width > used) ? width - used : 0;
+	bool lead = (spec->sign == PUTNUM_SIGN_NLEAD || spec->sign == PUTNUM_SIGN_PLEAD);
+	
+	if(lead){
+		// Sign and prefix go before the padding.
+		out -= padding;
+		memset(out, spec->pad, padding);
+	}
+	if(prefix){
+		out -= prefix;
+		memcpy(out, spec->prefix, prefix);
+	}
+	if(sign){
+		*--out = sign;
+	}
+	if(!lead){
+		out -= padding;
+		memset(out, spec->pad, padding);
 	}
 	
+	count = buf + FORMAT_MAX - out;
+	memmove(buf, out, count);
+	if(spec->left && width > count){
+		memset(&buf[count], ' ', width - count);
+		count = width;
+	}
 	return count;
 }
 
@@ -136,110 +375,337 @@ static unsigned int __putnum_actual(int num, unsigned int base, unsigned int gro
  * @return Non-negative if successful, EOF otherwise.
  */
 int puts(const char *str){
-	int count = 0;
-	size_t max = strlen(str);
-	for(unsigned int i = 0; i < max; ++i){
-		if(putchar(str[i]) != str[i]){
+	return fputs(str, stdout);
+}
+
+/**
+ * Length modifiers of integer conversions.
+ */
+enum format_length{
+	FORMAT_INT,          //!< No modifier.
+	FORMAT_CHAR,         //!< hh
+	FORMAT_SHORT,        //!< h
+	FORMAT_LONG,         //!< l
+	FORMAT_LONG_LONG,    //!< ll
+	FORMAT_INTMAX,       //!< j
+	FORMAT_SIZE,         //!< z
+	FORMAT_PTRDIFF       //!< t
+};
+
+/**
+ * Reads a signed integer argument.
+ * @param ap The argument list.
+ * @param length The length modifier of the conversion.
+ * @return The argument.
+ */
+static int64_t format_signed(va_list *ap, enum format_length length){
+	switch(length){
+		case FORMAT_CHAR:
+			return (signed char)va_arg(*ap, int);
+		case FORMAT_SHORT:
+			return (short)va_arg(*ap, int);
+		case FORMAT_LONG:
+			return va_arg(*ap, long);
+		case FORMAT_LONG_LONG:
+			return va_arg(*ap, long long);
+		case FORMAT_INTMAX:
+			return va_arg(*ap, intmax_t);
+		case FORMAT_SIZE:
+			return va_arg(*ap, ssize_t);
+		case FORMAT_PTRDIFF:
+			return va_arg(*ap, ptrdiff_t);
+		case FORMAT_INT:
+		default:
+			return va_arg(*ap, int);
+	}
+}
+
+/**
+ * Reads an unsigned integer argument.
+ * @param ap The argument list.
+ * @param length The length modifier of the conversion.
+ * @return The argument.
+ */
+static uint64_t format_unsigned(va_list *ap, enum format_length length){
+	switch(length){
+		case FORMAT_CHAR:
+			return (unsigned char)va_arg(*ap, unsigned int);
+		case FORMAT_SHORT:
+			return (unsigned short)va_arg(*ap, unsigned int);
+		case FORMAT_LONG:
+			return va_arg(*ap, unsigned long);
+		case FORMAT_LONG_LONG:
+			return va_arg(*ap, unsigned long long);
+		case FORMAT_INTMAX:
+			return va_arg(*ap, uintmax_t);
+		case FORMAT_SIZE:
+			return va_arg(*ap, size_t);
+		case FORMAT_PTRDIFF:
+			return (size_t)va_arg(*ap, ptrdiff_t);
+		case FORMAT_INT:
+		default:
+			return va_arg(*ap, unsigned int);
+	}
+}
+
+/**
+ * Destination of formatted output.
+ */
+typedef struct format_sink{
+	/**
+	 * Writes formatted output to the destination.
+	 * @param sink The sink to write to.
+	 * @param str Characters to write.
+	 * @param count Number of characters.
+	 * @return Zero if successful, EOF otherwise.
+	 */
+	int (*write)(struct format_sink *sink, const char *str, size_t count);
+	void *dest;      //!< Buffer, stream or device to write to.
+	size_t size;     //!< Size of the buffer.
+	size_t count;    //!< Number of characters formatted so far.
+} format_sink;
+
+/**
+ * Writes formatted output to a buffer, dropping what does not fit.
+ * One character is kept free for the terminator.
+ * @param sink The sink to write to.
+ * @param str Characters to write.
+ * @param count Number of characters.
+ * @return Zero.
+ */
+static int sink_buffer(format_sink *sink, const char *str, size_t count){
+	if(sink->count + 1 < sink->size){
+		size_t room = sink->size - 1 - sink->count;
+		memcpy((char*)sink->dest + sink->count, str, count < room ? count : room);
+	}
+	return 0;
+}
+
+/**
+ * Writes formatted output to a stream.
+ * @param sink The sink to write to.
+ * @param str Characters to write.
+ * @param count Number of characters.
+ * @return Zero if successful, EOF otherwise.
+ */
+static int sink_stream(format_sink *sink, const char *str, size_t count){
+	return stream_write(sink->dest, str, count);
+}
+
+/**
+ * Writes formatted output straight to a device.
+ * @param sink The sink to write to.
+ * @param str Characters to write.
+ * @param count Number of characters.
+ * @return Zero if successful, EOF otherwise.
+ */
+static int sink_device(format_sink *sink, const char *str, size_t count){
+	if(device_write(sink->dest, 0, str, count) != (ssize_t)count){
+		return EOF;
+	}
+	return 0;
+}
+
+/**
+ * Writes characters to a sink and counts them.
+ * @param sink The sink to write to.
+ * @param str Characters to write.
+ * @param count Number of characters.
+ * @return Zero if successful, EOF otherwise.
+ */
+static int format_emit(format_sink *sink, const char *str, size_t count){
+	if(count && sink->write(sink, str, count)){
+		return EOF;
+	}
+	sink->count += count;
+	return 0;
+}
+
+/**
+ * Writes characters to a sink, padded with spaces to a minimum width.
+ * @param sink The sink to write to.
+ * @param str Characters to write.
+ * @param count Number of characters.
+ * @param width Minimum number of characters to write.
+ * @param left Pad on the right instead of the left.
+ * @return Zero if successful, EOF otherwise.
+ */
+static int format_pad(format_sink *sink, const char *str, size_t count, unsigned int width, bool left){
+	static const char spaces[] = "                ";
+	size_t padding = width > count ? width - count : 0;
+	if(left && format_emit(sink, str, count)){
+		return EOF;
+	}
+	while(padding){
+		size_t chunk = padding < sizeof(spaces) - 1 ? padding : sizeof(spaces) - 1;
+		if(format_emit(sink, spaces, chunk)){
 			return EOF;
 		}
-		++count;
+		padding -= chunk;
+	}
+	if(!left && format_emit(sink, str, count)){
+		return EOF;
+	}
+	return 0;
+}
+
+/**
+ * Formats a floating point number into a buffer.
+ * @param buf Buffer of FORMAT_MAX characters.
+ * @param num The number to format.
+ * @param prec The number of places after the decimal, at most FORMAT_MAX/4.
+ * @return Number of characters in the buffer.
+ */
+static size_t format_float(char *buf, double num, unsigned int prec){
+	format_spec spec = {0, -1, 0, PUTNUM_SIGN_NLEAD, false, false, 0, 0, 0, NULL};
+	bool negative = (num < 0);
+	if(negative){
+		num = -num;
+	}
+	if(prec > FORMAT_MAX/4){
+		prec = FORMAT_MAX/4;
+	}
+	// Round to the last printed place.
+	double half = 0.5;
+	for(unsigned int i = 0; i < prec; ++i){
+		half /= 10;
+	}
+	num += half;
+	
+	uint64_t whole = (int64_t)num;
+	size_t count = format_int(buf, whole, negative, 10, &spec);
+	if(prec){
+		buf[count++] = '.';
+		num -= whole;
+		for(unsigned int i = 0; i < prec; ++i){
+			num *= 10;
+			int digit = (int)num;
+			buf[count++] = digit + '0';
+			num -= digit;
+		}
 	}
 	return count;
 }
 
 /**
- * Prints a string to stdout using the specified format.
+ * Formats a string into a sink.
+ * @param sink The sink to write to.
  * @param format Format string.
- * @param ... The values used in the format.
- * @return Number of characters written if successful, EOF otherwise.
+ * @param ap The values used in the format.
+ * @return Number of characters formatted if successful, EOF otherwise.
  */
-int printf(const char *format, ...){
-	unsigned int count = 0;
-	va_list ap;
-	va_start(ap, format);
+static int format_core(format_sink *sink, const char *format, va_list ap){
 	size_t max = strlen(format);
 	for(unsigned int i = 0; i < max; ++i){
 		if(format[i] != '%'){
-			if(putchar(format[i]) == EOF){
-				va_end(ap);
+			// Write everything up to the next conversion at once.
+			const char *next = memchr(&format[i], '%', max - i);
+			size_t run = next ? (size_t)(next - &format[i]) : max - i;
+			if(format_emit(sink, &format[i], run)){
 				return EOF;
 			}
-			++count;
+			i += run - 1;
 		}else{
 			bool handled = false;
 			bool left = false;
 			bool show_radix = false;
-			enum putnum_sign sign = PUTNUM_SIGN_NLEAD;
+			bool plus = false;
 			char pad = ' ';
 			unsigned int width = 0;
 			bool dot = false;
 			unsigned int precision = 0;
-			unsigned int lastcount = count;
+			enum format_length length = FORMAT_INT;
+			char buf[FORMAT_MAX];
 			while(!handled){
 				++i;
 				char type = format[i];
-				if(type == 'p'){
-					int ret = puts("0x");
-					if(ret < 0){
-						va_end(ap);
-						return EOF;
-					}
-					count += ret;
-					type = 'X';
-					width = 8;
-				}
 				if(type == '%'){
-					if(putchar(format[i]) == EOF){
-						va_end(ap);
+					if(format_emit(sink, "%", 1)){
 						return EOF;
 					}
-					++count;
 					handled = true;
 				}else if(type == 'c'){
-					putchar((char)(va_arg(ap, int) & 0x000000FF));
-					++count;
-					handled = true;
-				}else if(type == 's'){
-					int ret = puts(va_arg(ap, char*));
-					if(ret < 0){
-						va_end(ap);
+					buf[0] = (char)(va_arg(ap, int) & 0x000000FF);
+					if(format_pad(sink, buf, 1, width, left)){
 						return EOF;
 					}
-					count += ret;
 					handled = true;
-				}else if(type == 'i' || type == 'd'){
-					count += putnum(va_arg(ap, int), 10, 3, 0, 0, width, pad, sign, false);
-					handled = true;
-				}else if(type == 'u'){
-					count += putnum(va_arg(ap, unsigned int), 10, 3, 0, 0, width, pad, sign, false);
-					handled = true;
-				}else if(type == 'x' || type == 'X'){
-					bool cap = false;
-					if(type == 'X'){
-						cap = true;
+				}else if(type == 's'){
+					const char *str = va_arg(ap, char*);
+					if(str == NULL){
+						str = "(null)";
 					}
-					if(show_radix){
-						count += puts("0x");
+					size_t len = strlen(str);
+					if(dot && precision < len){
+						len = precision;
+					}
+					if(format_pad(sink, str, len, width, left)){
+						return EOF;
 					}
-					count += putnum(va_arg(ap, unsigned int), 16, 4, 0, 0, width, pad, PUTNUM_SIGN_NONE, cap);
 					handled = true;
-				}else if(type == 'o'){
-					if(show_radix){
-						putchar('0');
-						++count;
+				}else if(type == 'i' || type == 'd' || type == 'u' || type == 'x' || type == 'X' || type == 'o' || type == 'p'){
+					format_spec spec = {width, dot ? (int)precision : -1, pad, PUTNUM_SIGN_NLEAD, left, (type == 'X'), 0, 0, 0, NULL};
+					unsigned int base = 10;
+					uint64_t num;
+					bool negative = false;
+					if(type == 'i' || type == 'd'){
+						int64_t value = format_signed(&ap, length);
+						negative = (value < 0);
+						num = negative ? -(uint64_t)value : (uint64_t)value;
+						// Zero padding goes between the sign and the digits.
+						if(plus){
+							spec.sign = (pad == '0') ? PUTNUM_SIGN_PLEAD : PUTNUM_SIGN_PEMBED;
+						}else{
+							spec.sign = (pad == '0') ? PUTNUM_SIGN_NLEAD : PUTNUM_SIGN_NEMBED;
+						}
+					}else if(type == 'p'){
+						num = (uintptr_t)va_arg(ap, void*);
+						base = 16;
+						// Never negative, leading keeps the zeros after the prefix.
+						spec.sign = PUTNUM_SIGN_NLEAD;
+						spec.cap = true;
+						spec.prefix = "0x";
+						spec.width = 10;
+						spec.pad = '0';
+					}else{
+						num = format_unsigned(&ap, length);
+						spec.sign = (pad == '0') ? PUTNUM_SIGN_NLEAD : PUTNUM_SIGN_NEMBED;
+						if(type == 'x' || type == 'X'){
+							base = 16;
+							spec.prefix = (show_radix && num) ? "0x" : NULL;
+						}else if(type == 'o'){
+							base = 8;
+							spec.prefix = (show_radix && num) ? "0" : NULL;
+						}
+					}
+					size_t len = format_int(buf, num, negative, base, &spec);
+					if(format_emit(sink, buf, len)){
+						return EOF;
 					}
-					count += putnum(va_arg(ap, unsigned int), 8, 3, 0, 0, width, pad, PUTNUM_SIGN_NONE, false);
 					handled = true;
 				}else if(type == 'f'){
-					count += putfloat(va_arg(ap, double), precision);
+					size_t len = format_float(buf, va_arg(ap, double), dot ? precision : 6);
+					if(format_pad(sink, buf, len, width, left)){
+						return EOF;
+					}
 					handled = true;
 				}else if(type == 'n'){
-					*(va_arg(ap, int*)) = count;
+					*(va_arg(ap, int*)) = sink->count;
 					handled = true;
+				}else if(type == 'h'){
+					length = (length == FORMAT_SHORT) ? FORMAT_CHAR : FORMAT_SHORT;
+				}else if(type == 'l'){
+					length = (length == FORMAT_LONG) ? FORMAT_LONG_LONG : FORMAT_LONG;
+				}else if(type == 'j'){
+					length = FORMAT_INTMAX;
+				}else if(type == 'z'){
+					length = FORMAT_SIZE;
+				}else if(type == 't'){
+					length = FORMAT_PTRDIFF;
 				}else if(type == '-'){
 					left = true;
 				}else if(type == '+'){
-					sign = PUTNUM_SIGN_PLEAD;
+					plus = true;
 				}else if(type == '#'){
 					show_radix = true;
 				}else if(type == '0' && (width == 0 || dot)){
@@ -258,18 +724,132 @@ int printf(const char *format, ...){
 					}
 				}else if(type == '.'){
 					dot = true;
-				}
-			}
-			if(left && lastcount + width < count){
-				for(unsigned int s = 0; s < lastcount + width; ++s){
-					putchar(' ');
-					++count;
+				}else if(type == 0){
+					// Format ended in the middle of a conversion.
+					--i;
+					handled = true;
 				}
 			}
 		}
 	}
+	return sink->count;
+}
+
+/**
+ * Prints a string to stdout using the specified format.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int printf(const char *format, ...){
+	va_list ap;
+	va_start(ap, format);
+	int ret = vfprintf(stdout, format, ap);
+	va_end(ap);
+	return ret;
+}
+
+/**
+ * Prints a string to a stream using the specified format.
+ * @param stream The stream to write to.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int fprintf(FILE *stream, const char *format, ...){
+	va_list ap;
+	va_start(ap, format);
+	int ret = vfprintf(stream, format, ap);
+	va_end(ap);
+	return ret;
+}
+
+/**
+ * Prints a string to a stream using the specified format.
+ * @param stream The stream to write to.
+ * @param format Format string.
+ * @param ap The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int vfprintf(FILE *stream, const char *format, va_list ap){
+	format_sink sink = {sink_stream, stream, 0, 0};
+	return format_core(&sink, format, ap);
+}
+
+/**
+ * Prints a string straight to a device using the specified format.
+ * @param dev The device to write to.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Number of characters written if successful, EOF otherwise.
+ */
+int devprintf(device_descriptor *dev, const char *format, ...){
+	va_list ap;
+	va_start(ap, format);
+	format_sink sink = {sink_device, dev, 0, 0};
+	int ret = format_core(&sink, format, ap);
+	va_end(ap);
+	return ret;
+}
+
+/**
+ * Formats a string into a buffer.
+ * At most n-1 characters are written, followed by a terminator.
+ * @param buf Buffer to write to, may be NULL if n is zero.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ap The values used in the format.
+ * @return Length of the whole formatted string, even if it was truncated.
+ */
+int vsnprintf(char *buf, size_t n, const char *format, va_list ap){
+	format_sink sink = {sink_buffer, buf, n, 0};
+	int ret = format_core(&sink, format, ap);
+	if(n){
+		buf[sink.count < n ? sink.count : n - 1] = '\0';
+	}
+	return ret;
+}
+
+/**
+ * Formats a string into a buffer.
+ * At most n-1 characters are written, followed by a terminator.
+ * @param buf Buffer to write to, may be NULL if n is zero.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Length of the whole formatted string, even if it was truncated.
+ */
+int snprintf(char *buf, size_t n, const char *format, ...){
+	va_list ap;
+	va_start(ap, format);
+	int ret = vsnprintf(buf, n, format, ap);
 	va_end(ap);
-	return count;
+	return ret;
+}
+
+/**
+ * Formats a string into a buffer, failing if it does not fit.
+ * @param buf Buffer to write to.
+ * @param n Size of the buffer.
+ * @param format Format string.
+ * @param ... The values used in the format.
+ * @return Length of the formatted string, or zero if a runtime-constraint
+ * is violated.
+ */
+int sprintf_s(char *buf, rsize_t n, const char *format, ...){
+	constraint((buf != NULL), EFAULT, 0);
+	constraint((n > 0 && n <= RSIZE_MAX), EFAULT, 0);
+	buf[0] = '\0';
+	constraint((format != NULL), EFAULT, 0);
+	va_list ap;
+	va_start(ap, format);
+	int ret = vsnprintf(buf, n, format, ap);
+	va_end(ap);
+	if(ret >= 0 && (rsize_t)ret >= n){
+		buf[0] = '\0';
+	}
+	constraint((ret >= 0 && (rsize_t)ret < n), ERANGE, 0);
+	return ret;
 }
 
 /**
@@ -277,10 +857,9 @@ int printf(const char *format, ...){
  * @param str String to write.
  */
 void perror(const char *str){
-	size_t max = strlen(str);
-	for(unsigned int i = 0; i < max; ++i){
-		stderr->swrite(str[i]);
-	}
+	// Keep the output in order when both go to the same device.
+	fflush(stdout);
+	fputs(str, stderr);
 }
 
 /**
@@ -289,10 +868,10 @@ void perror(const char *str){
  * @return ch if successful, EOF otherwise.
  */
 char putchar(char ch){
-	if(stdout->swrite(ch) == EOK){
-		return ch;
+	if(stream_write(stdout, &ch, 1)){
+		return EOF;
 	}
-	return EOF;
+	return ch;
 }
 
 /**
@@ -309,7 +888,15 @@ char putchar(char ch){
  * @return Number of characters written.
  */
 unsigned int putnum(int num, unsigned int base, unsigned int group_size, char digit_sep, char group_sep, unsigned int length, char pad, enum putnum_sign neg, bool cap){
-	return __putnum_actual(num, base, group_size, digit_sep, group_sep, length, pad, neg, cap, 0, false);
+	format_spec spec = {length, -1, pad, neg, false, cap, group_size, digit_sep, group_sep, NULL};
+	bool negative = (neg != PUTNUM_SIGN_NONE && num < 0);
+	uint64_t mag = negative ? (uint64_t)-(int64_t)num : (uint32_t)num;
+	char buf[FORMAT_MAX];
+	size_t count = format_int(buf, mag, negative, base, &spec);
+	if(stream_write(stdout, buf, count)){
+		return 0;
+	}
+	return count;
 }
 
 /**
@@ -355,16 +942,10 @@ int puthex(unsigned int num){
  * @return Number of characters written.
  */
 int putfloat(double num, uint8_t prec){
-	int count = 0;
-	count += putint((int)num);
-	putchar('.');
-	++count;
-	num -= (int)num;
-	for(int i = 0; i < prec; ++i){
-		num *= 10;
-		putchar((int)num+'0');
-		++count;
-		num -= (int)num;
+	char buf[FORMAT_MAX];
+	size_t count = format_float(buf, num, prec);
+	if(stream_write(stdout, buf, count)){
+		return 0;
 	}
 	return count;
 }
@@ -374,7 +955,9 @@ int putfloat(double num, uint8_t prec){
  * @return The character received.
  */
 unsigned char getchar(){
-	return stdin->sread();
+	// Show any prompt before waiting for input.
+	fflush(stdout);
+	return stdin->dev->sread();
 }
 
 /**
@@ -7,96 +7,206 @@
 #include "stdlib.h"
 
 #include <errno.h>
+#include <kernel/int.h>
 #include <signal.h>
-#include <stdio.h>
+#include <stdbool.h>
 #include <stdint.h>
-#include "dev/ram.h"
+#include <string.h>
 #include "hal/rand.h"
 #include "constraint.h"
+#include "heap.h"
+#include "slab.h"
 
-typedef uint32_t HEAP_T;               //!< Integer type to use for heap allocations.
-const uint8_t HEAP_HEAD_SIZE = 2;              //!< Number of HEAP_T's in the header.
-const uint8_t HEAP_ALIGN = sizeof(HEAP_T);     //!< Alignment of all heap allocations.
-const uint32_t HEAP_BLOCK_USED = ((HEAP_T)0x80000000);    //!< Block used flag.
+enum {
+	HEAP_TRACE_SIZE = 64    //!< Number of entries in the trace ring.
+};
 
-static HEAP_T *heap = 0;
+static heap_stats stats;                            //!< Allocation statistics.
+static heap_trace_entry trace[HEAP_TRACE_SIZE];     //!< Ring of recent allocations and frees.
+static uint32_t trace_count = 0;                    //!< Number of entries ever written to trace.
+static bool trace_enabled = false;                  //!< Allocations and frees are being traced.
 
-static uint32_t used = 0;
-static uint32_t free_count = 0;
+/**
+ * Gets the usable size of an allocation.
+ * @param ptr The allocation.
+ * @return Number of bytes the allocation can hold.
+ */
+static size_t heap_usable(const void *ptr){
+	return heap_is_slab(ptr) ? slab_size(ptr) : heap_size(ptr);
+}
 
 /**
- * Initializes the heap.
- * @param start Null terminated array of pointers to the start of heap spaces.
- * @param end Null terminated array of pointers to the end of heap spaces.
- * @return Error code, or EOK if successful.
+ * Records an allocation or free in the statistics and trace.
+ * @param ptr The allocation.
+ * @param size Usable size of the allocation.
+ * @param alloc true for an allocation, false for a free.
+ * @param caller Return address of the caller.
  */
-int heap_init(void *start[], void *end[]){
-	// Do not reinitialize the heap!
-	if(heap != 0){
-		return ECANCELED;
+static void heap_record(void *ptr, size_t size, bool alloc, void *caller){
+	if(alloc){
+		stats.used += size;
+		if(stats.used > stats.peak){
+			stats.peak = stats.used;
+		}
+		++stats.allocs;
+		if(heap_is_slab(ptr)){
+			// Slab sizes are powers of two from 16 bytes.
+			++stats.class_allocs[27 - __builtin_clz(size)];
+		}else{
+			++stats.class_allocs[HEAP_STAT_CLASSES - 1];
+		}
+	}else{
+		stats.used -= size;
+		++stats.frees;
 	}
 	
-	heap = (HEAP_T*)start[0];
-	for(int i = 0; start[i] && end[i]; ++i){
-		HEAP_T *head = (HEAP_T*)start[i];
-		HEAP_T *tail = ((HEAP_T*)end[i] - 1);
-		
-		// Create the heap header.
-		head[0] = (HEAP_T)start[i+1];    // Pointer to the next heap block.
-		head[1] = (HEAP_T)(((uint8_t*)end[i] - (uint8_t*)start[i]) / HEAP_ALIGN);    // Size of the heap block.
-		free_count += head[1];
-		*tail = 0;    // Null Terminate the heap.
-		
-		// Allocate the first block.
-		head[2] = (HEAP_T)NULL;    // Pointer to the previous allocation block.
-		head[3] = head[1] - HEAP_HEAD_SIZE + 1;    // Size of the allocation block.
+	if(trace_enabled){
+		heap_trace_entry *entry = &trace[trace_count % HEAP_TRACE_SIZE];
+		entry->ptr = ptr;
+		entry->size = size;
+		entry->caller = caller;
+		entry->alloc = alloc;
+		++trace_count;
+	}
+}
+
+/**
+ * Allocates memory without recording it.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the allocated space.
+ */
+static void *heap_get(size_t size){
+	if(size <= SLAB_MAX){
+		return slab_alloc(size);
+	}
+	return heap_alloc(size, sizeof(uint64_t));
+}
+
+/**
+ * Deallocates memory without recording it.
+ * @param ptr Pointer to the space to deallocate.
+ */
+static void heap_put(void *ptr){
+	if(heap_is_slab(ptr)){
+		slab_free(ptr);
+	}else{
+		heap_free(ptr);
 	}
-	
-	return EOK;
 }
 
 /**
  * Allocates memory on the heap.
+ * Small requests come from a size class slab, larger ones from the heap
+ * regions directly.  Like every function here that touches the heap, the
+ * slabs or the statistics, this runs with interrupts disabled so another
+ * thread cannot be switched in halfway through.
  * @param size Number of bytes to allocate.
  * @return Pointer to the allocated space.
  */
-void *malloc(uint32_t size){
-	HEAP_T *head = heap;
-	HEAP_T *block = heap + HEAP_HEAD_SIZE;
-	
-	size += HEAP_ALIGN - (size % HEAP_ALIGN);
-	size = size / HEAP_ALIGN;    // Size is now in number of HEAP_T's.
-	size += HEAP_HEAD_SIZE;
+void *malloc(size_t size){
+	uint32_t flags = int_save();
+	void *ptr = heap_get(size);
+	if(ptr){
+		heap_record(ptr, heap_usable(ptr), true, __builtin_return_address(0));
+	}
+	int_restore(flags);
+	return ptr;
+}
+
+/**
+ * Allocates zeroed memory for an array on the heap.
+ * @param count Number of elements.
+ * @param size Size of each element.
+ * @return Pointer to the allocated space, or NULL on failure or overflow.
+ */
+void *calloc(size_t count, size_t size){
+	if(size != 0 && count > SIZE_MAX / size){
+		return NULL;
+	}
+	uint32_t flags = int_save();
+	void *ptr = heap_get(count * size);
+	if(ptr){
+		heap_record(ptr, heap_usable(ptr), true, __builtin_return_address(0));
+	}
+	int_restore(flags);
+	if(ptr){
+		memset(ptr, 0, count * size);
+	}
+	return ptr;
+}
+
+/**
+ * Allocates aligned memory on the heap.
+ * @param align Alignment of the space, a power of two.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the allocated space, or NULL on failure.
+ */
+void *aligned_alloc(size_t align, size_t size){
+	if(align == 0 || (align & (align - 1))){
+		return NULL;
+	}
+	// Slab objects are aligned to their size class.
+	size_t slab = (size > align) ? size : align;
+	uint32_t flags = int_save();
+	void *ptr = (slab <= SLAB_MAX) ? slab_alloc(slab) : heap_alloc(size, align);
+	if(ptr){
+		heap_record(ptr, heap_usable(ptr), true, __builtin_return_address(0));
+	}
+	int_restore(flags);
+	return ptr;
+}
+
+/**
+ * Changes the size of an allocation on the heap.
+ * The contents are kept up to the smaller of the old and new sizes.
+ * @param ptr Pointer to the space to resize, or NULL to allocate.
+ * @param size New number of bytes.
+ * @return Pointer to the resized space, or NULL on failure.
+ */
+void *realloc(void *ptr, size_t size){
+	void *caller = __builtin_return_address(0);
+	uint32_t flags = int_save();
+	if(ptr == NULL){
+		ptr = heap_get(size);
+		if(ptr){
+			heap_record(ptr, heap_usable(ptr), true, caller);
+		}
+		int_restore(flags);
+		return ptr;
+	}
+	if(size == 0){
+		heap_record(ptr, heap_usable(ptr), false, caller);
+		heap_put(ptr);
+		int_restore(flags);
+		return NULL;
+	}
 	
-	while(head){
-		while(block < head + head[1]){
-			if(!(block[1] & HEAP_BLOCK_USED) && block[1] >= size){
-				// Allocate this block.
-				if(block[1] > size){
-					if(block[1] - size >= HEAP_HEAD_SIZE){
-						// There is at least enough space for the header.
-						HEAP_T *next = block + size;
-						next[0] = (HEAP_T)block;
-						next[1] = block[1] - size;
-					}else{
-						// Allocate the extra space with this block.
-						size = block[1];
-					}
-				}
-				block[1] = size | HEAP_BLOCK_USED;    // Mark the block as used.
-				free_count -= size;
-				used += size;
-				printf("Free = %u    Used = %u\n", free_count, used);
-				return (void*)(block + HEAP_HEAD_SIZE);
-			}
-			
-			block = block + (block[1] & ~HEAP_BLOCK_USED);    // Advance to next allocation block.
+	size_t old = heap_usable(ptr);
+	if(heap_is_slab(ptr)){
+		if(size <= old && size > old / 2){
+			// Still the same size class.
+			int_restore(flags);
+			return ptr;
 		}
-		
-		head = (HEAP_T*)head[0];    // Advance to next heap block.
+	}else if(size > SLAB_MAX && heap_resize(ptr, size)){
+		heap_record(ptr, old, false, caller);
+		heap_record(ptr, heap_size(ptr), true, caller);
+		int_restore(flags);
+		return ptr;
 	}
 	
-	return NULL;
+	void *moved = heap_get(size);
+	int_restore(flags);
+	if(moved){
+		// Both blocks belong to the caller, copy with interrupts enabled.
+		memcpy(moved, ptr, (old < size) ? old : size);
+		flags = int_save();
+		heap_record(ptr, old, false, caller);
+		heap_put(ptr);
+		heap_record(moved, heap_usable(moved), true, caller);
+		int_restore(flags);
+	}
+	return moved;
 }
 
 /**
@@ -104,32 +214,54 @@ void *malloc(uint32_t size){
  * @param ptr Pointer to the space to deallocate.
  */
 void free(void *ptr){
-	HEAP_T *block = (HEAP_T*)ptr;
-	block -= HEAP_HEAD_SIZE;
-	
-	HEAP_T *prev = (HEAP_T*)block[0];
-	HEAP_T *next = block + block[1];
-	
-	block[1] = block[1] & ~HEAP_BLOCK_USED;    // Mark the block free.
-	free_count += block[1];
-	used -= block[1];
-	
-	// Check if previous block is free.
-	if(prev){
-		if(prev[1] & ~HEAP_BLOCK_USED){
-			prev[1] += block[1];
-			block = prev;
-		}
-	}
-	
-	// Check if next block is free.
-	if(next){
-		if(next[1] & ~HEAP_BLOCK_USED){
-			block[1] += next[1];
-		}
+	if(ptr == NULL){
+		return;
 	}
+	uint32_t flags = int_save();
+	heap_record(ptr, heap_usable(ptr), false, __builtin_return_address(0));
+	heap_put(ptr);
+	int_restore(flags);
+}
+
+/**
+ * Gets the heap statistics.
+ * @param out Structure to fill.
+ */
+void heap_get_stats(heap_stats *out){
+	uint32_t flags = int_save();
+	*out = stats;
+	heap_space(&out->free, &out->largest);
+	int_restore(flags);
+	// Percent of the free space that is not in the largest free block.
+	out->fragmentation = (out->free >= 100) ? (out->free - out->largest) / (out->free / 100) : 0;
 }
 
+/**
+ * Enables or disables tracing of allocations and frees.
+ * @param enable true to record a trace.
+ */
+void heap_trace(bool enable){
+	trace_enabled = enable;
+}
+
+/**
+ * Reads the most recent trace entries.
+ * @param entries Array to fill, oldest entry first.
+ * @param max Number of entries in the array.
+ * @return Number of entries filled.
+ */
+size_t heap_trace_read(heap_trace_entry *entries, size_t max){
+	uint32_t flags = int_save();
+	size_t count = (trace_count < HEAP_TRACE_SIZE) ? trace_count : HEAP_TRACE_SIZE;
+	if(count > max){
+		count = max;
+	}
+	for(size_t i = 0; i < count; ++i){
+		entries[i] = trace[(trace_count - count + i) % HEAP_TRACE_SIZE];
+	}
+	int_restore(flags);
+	return count;
+}
 
 /**
  * Generates a random number.
@@ -6,7 +6,265 @@
 
 #include "string.h"
 
+#include <kernel/int.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "sys/fpu.h"
+
+enum {
+	STRING_REP_MIN  = 64,     //!< Shortest run worth a rep movsd or rep stosd.
+	STRING_SSE_MIN  = 512,    //!< Shortest run worth saving SSE registers for.
+	STRING_SCAN_MIN = 64      //!< Bytes of a string scanned by words before using SSE.
+};
+
+#define STRING_ONES  0x01010101u    //!< A one in every byte of a word.
+#define STRING_HIGHS 0x80808080u    //!< The high bit of every byte of a word.
+
+/**
+ * Checks if any byte of a word is zero.
+ * @param W The word.
+ */
+#define STRING_HAS_ZERO(W) (((W) - STRING_ONES) & ~(W) & STRING_HIGHS)
+
+/**
+ * Copies 64 byte blocks with SSE2.
+ * The registers used are saved and restored, so this is safe in interrupts.
+ * @param dest The destination address, 16 byte aligned.
+ * @param src The source address.
+ * @param blocks The number of 64 byte blocks to copy.
+ */
+static void mem_copy_sse2(uint8_t *dest, const uint8_t *src, size_t blocks){
+	uint8_t save[64];
+	asm volatile(
+		"movdqu %%xmm0, 0(%3);"
+		"movdqu %%xmm1, 16(%3);"
+		"movdqu %%xmm2, 32(%3);"
+		"movdqu %%xmm3, 48(%3);"
+		"1:"
+		"movdqu 0(%1), %%xmm0;"
+		"movdqu 16(%1), %%xmm1;"
+		"movdqu 32(%1), %%xmm2;"
+		"movdqu 48(%1), %%xmm3;"
+		"movdqa %%xmm0, 0(%0);"
+		"movdqa %%xmm1, 16(%0);"
+		"movdqa %%xmm2, 32(%0);"
+		"movdqa %%xmm3, 48(%0);"
+		"addl $64, %1;"
+		"addl $64, %0;"
+		"decl %2;"
+		"jnz 1b;"
+		"movdqu 0(%3), %%xmm0;"
+		"movdqu 16(%3), %%xmm1;"
+		"movdqu 32(%3), %%xmm2;"
+		"movdqu 48(%3), %%xmm3"
+		: "+r"(dest), "+r"(src), "+r"(blocks)
+		: "r"(save)
+		: "memory", "cc"
+	);
+}
+
+/**
+ * Fills 64 byte blocks with SSE2.
+ * The register used is saved and restored, so this is safe in interrupts.
+ * @param dest The destination address, 16 byte aligned.
+ * @param word The value to write, repeated in each word.
+ * @param blocks The number of 64 byte blocks to write.
+ */
+static void mem_set_sse2(uint8_t *dest, uint32_t word, size_t blocks){
+	uint8_t save[16];
+	asm volatile(
+		"movdqu %%xmm0, (%3);"
+		"movd %2, %%xmm0;"
+		"pshufd $0, %%xmm0, %%xmm0;"
+		"1:"
+		"movdqa %%xmm0, 0(%0);"
+		"movdqa %%xmm0, 16(%0);"
+		"movdqa %%xmm0, 32(%0);"
+		"movdqa %%xmm0, 48(%0);"
+		"addl $64, %0;"
+		"decl %1;"
+		"jnz 1b;"
+		"movdqu (%3), %%xmm0"
+		: "+r"(dest), "+r"(blocks)
+		: "r"(word), "r"(save)
+		: "memory", "cc"
+	);
+}
+
+/**
+ * Searches 16 byte blocks for a byte with SSE2.
+ * The registers used are saved and restored, so this is safe in interrupts.
+ * Only aligned blocks are read, so the search never crosses into a page
+ * that does not hold part of the data.
+ * @param ptr The address of the first block, 16 byte aligned.  Set to the
+ *            block holding the byte, or the end of the last block.
+ * @param c The byte to find.
+ * @param blocks The number of blocks to search.
+ * @return Mask with a bit set for each match in the block, or 0 if not found.
+ */
+static uint32_t mem_find_sse2(const uint8_t **ptr, uint8_t c, size_t blocks){
+	const uint8_t *p = *ptr;
+	uint32_t mask = 0;
+	uint8_t save[32];
+	asm volatile(
+		"movdqu %%xmm0, 0(%3);"
+		"movdqu %%xmm1, 16(%3);"
+		"movd %4, %%xmm0;"
+		"punpcklbw %%xmm0, %%xmm0;"
+		"punpcklwd %%xmm0, %%xmm0;"
+		"pshufd $0, %%xmm0, %%xmm0;"
+		"1:"
+		"testl %2, %2;"
+		"jz 2f;"
+		"movdqa (%0), %%xmm1;"
+		"pcmpeqb %%xmm0, %%xmm1;"
+		"pmovmskb %%xmm1, %1;"
+		"testl %1, %1;"
+		"jnz 2f;"
+		"addl $16, %0;"
+		"decl %2;"
+		"jmp 1b;"
+		"2:"
+		"movdqu 0(%3), %%xmm0;"
+		"movdqu 16(%3), %%xmm1"
+		: "+r"(p), "+r"(mask), "+r"(blocks)
+		: "r"(save), "r"((uint32_t)c)
+		: "memory", "cc"
+	);
+	*ptr = p;
+	return mask;
+}
+
+/**
+ * Compares 16 byte blocks with SSE2.
+ * The registers used are saved and restored, so this is safe in interrupts.
+ * @param ptr1 The first address.  Set to the first differing block, or the
+ *             end of the last block.
+ * @param ptr2 The second address, advanced with ptr1.
+ * @param blocks The number of blocks to compare, at least 1.
+ * @return Mask with a bit set for each equal byte in the last block compared.
+ */
+static uint32_t mem_compare_sse2(const uint8_t **ptr1, const uint8_t **ptr2, size_t blocks){
+	const uint8_t *p1 = *ptr1;
+	const uint8_t *p2 = *ptr2;
+	uint32_t mask;
+	uint8_t save[32];
+	asm volatile(
+		"movdqu %%xmm0, 0(%4);"
+		"movdqu %%xmm1, 16(%4);"
+		"1:"
+		"movdqu (%0), %%xmm0;"
+		"movdqu (%1), %%xmm1;"
+		"pcmpeqb %%xmm1, %%xmm0;"
+		"pmovmskb %%xmm0, %2;"
+		"cmpl $0xFFFF, %2;"
+		"jne 2f;"
+		"addl $16, %0;"
+		"addl $16, %1;"
+		"decl %3;"
+		"jnz 1b;"
+		"2:"
+		"movdqu 0(%4), %%xmm0;"
+		"movdqu 16(%4), %%xmm1"
+		: "+r"(p1), "+r"(p2), "=&r"(mask), "+r"(blocks)
+		: "r"(save)
+		: "memory", "cc"
+	);
+	*ptr1 = p1;
+	*ptr2 = p2;
+	return mask;
+}
+
+/**
+ * Copies memory from low to high addresses.
+ * @param dest The destination address.
+ * @param src The source address.
+ * @param n The Number of bytes to copy.
+ */
+static void mem_forward(uint8_t *dest, const uint8_t *src, size_t n){
+	if(n >= STRING_REP_MIN){
+		// Align the destination so stores never straddle words.
+		while((uint32_t)dest & 3){
+			*dest++ = *src++;
+			--n;
+		}
+		if(n >= STRING_SSE_MIN && fpu_sse2()){
+			while((uint32_t)dest & 15){
+				*(uint32_t*)dest = *(const uint32_t*)src;
+				dest += 4;
+				src += 4;
+				n -= 4;
+			}
+			mem_copy_sse2(dest, src, n >> 6);
+			dest += n & ~63;
+			src += n & ~63;
+			n &= 63;
+		}
+		size_t words = n >> 2;
+		asm volatile(
+			"rep movsl"
+			: "+D"(dest), "+S"(src), "+c"(words)
+			:: "memory"
+		);
+		n &= 3;
+	}else{
+		while(n >= 4){
+			*(uint32_t*)dest = *(const uint32_t*)src;
+			dest += 4;
+			src += 4;
+			n -= 4;
+		}
+	}
+	while(n){
+		*dest++ = *src++;
+		--n;
+	}
+}
+
+/**
+ * Copies memory from high to low addresses.
+ * @param dest The destination address.
+ * @param src The source address.
+ * @param n The Number of bytes to copy.
+ */
+static void mem_backward(uint8_t *dest, const uint8_t *src, size_t n){
+	dest += n;
+	src += n;
+	if(n >= STRING_REP_MIN){
+		// Align the end of the destination.
+		while((uint32_t)dest & 3){
+			*--dest = *--src;
+			--n;
+		}
+		size_t words = n >> 2;
+		uint8_t *wdest = dest - 4;
+		const uint8_t *wsrc = src - 4;
+		// An interrupt must not run with the direction flag set.
+		uint32_t flags = int_save();
+		asm volatile(
+			"std;"
+			"rep movsl;"
+			"cld"
+			: "+D"(wdest), "+S"(wsrc), "+c"(words)
+			:: "memory"
+		);
+		int_restore(flags);
+		dest -= n & ~3;
+		src -= n & ~3;
+		n &= 3;
+	}else{
+		while(n >= 4){
+			dest -= 4;
+			src -= 4;
+			*(uint32_t*)dest = *(const uint32_t*)src;
+			n -= 4;
+		}
+	}
+	while(n){
+		*--dest = *--src;
+		--n;
+	}
+}
 
 /**
  * Copies the first n bytes of src to dest.
@@ -15,8 +273,9 @@
  * @param n The Number of bytes to copy.
  * @return A pointer to dest.
  */
-inline void *memcpy(void *restrict dest, const void *restrict src, size_t n){
-	return memmove(dest, src, n);
+void *memcpy(void *restrict dest, const void *restrict src, size_t n){
+	mem_forward(dest, src, n);
+	return dest;
 }
 
 /**
@@ -27,24 +286,13 @@ inline void *memcpy(void *restrict dest, const void *restrict src, size_t n){
  * @return A pointer to dest.
  */
 void *memmove(void *dest, const void *src, size_t n){
-	unsigned char *pdest = dest;
-	const unsigned char *psrc = src;
-	if(pdest < psrc){
-		while(n){
-			*pdest = *psrc;
-			++pdest;
-			++psrc;
-			--n;
-		}
+	uint8_t *pdest = dest;
+	const uint8_t *psrc = src;
+	if(pdest < psrc || pdest >= psrc + n){
+		mem_forward(pdest, psrc, n);
 	}else if(pdest > psrc){
-		pdest = pdest + n - 1;
-		psrc = psrc + n - 1;
-		while(n){
-			*pdest = *psrc;
-			--pdest;
-			--psrc;
-			--n;
-		}
+		// Overlapping with dest above src, copy from the end.
+		mem_backward(pdest, psrc, n);
 	}
 	return dest;
 }
@@ -101,10 +349,40 @@ void *memccpy(void *restrict dest, const void *restrict src, char c, size_t n){
  * @return A pointer to dest.
  */
 void *memset(void *dest, char c, size_t n){
-	unsigned char *pdest = dest;
+	uint8_t *pdest = dest;
+	uint32_t word = (uint8_t)c * 0x01010101u;
+	if(n >= STRING_REP_MIN){
+		while((uint32_t)pdest & 3){
+			*pdest++ = c;
+			--n;
+		}
+		if(n >= STRING_SSE_MIN && fpu_sse2()){
+			while((uint32_t)pdest & 15){
+				*(uint32_t*)pdest = word;
+				pdest += 4;
+				n -= 4;
+			}
+			mem_set_sse2(pdest, word, n >> 6);
+			pdest += n & ~63;
+			n &= 63;
+		}
+		size_t words = n >> 2;
+		asm volatile(
+			"rep stosl"
+			: "+D"(pdest), "+c"(words)
+			: "a"(word)
+			: "memory"
+		);
+		n &= 3;
+	}else{
+		while(n >= 4){
+			*(uint32_t*)pdest = word;
+			pdest += 4;
+			n -= 4;
+		}
+	}
 	while(n){
-		*pdest = c;
-		++pdest;
+		*pdest++ = c;
 		--n;
 	}
 	return dest;
@@ -118,10 +396,36 @@ void *memset(void *dest, char c, size_t n){
  * @return A pointer to the location, or NULL if not found.
  */
 void *memchr(const void *src, char c, size_t n){
-	const unsigned char *psrc = src;
+	const uint8_t *psrc = src;
+	const uint8_t find = (uint8_t)c;
+	while(n && ((uint32_t)psrc & 3)){
+		if(*psrc == find){
+			return (void*)psrc;
+		}
+		++psrc;
+		--n;
+	}
+	
+	const uint32_t pattern = find * STRING_ONES;
+	while(n >= 4){
+		if(n >= STRING_SSE_MIN && !((uint32_t)psrc & 15) && fpu_sse2()){
+			uint32_t mask = mem_find_sse2(&psrc, find, n >> 4);
+			if(mask){
+				return (void*)(psrc + __builtin_ctz(mask));
+			}
+			n &= 15;
+			continue;
+		}
+		if(STRING_HAS_ZERO(*(const uint32_t*)psrc ^ pattern)){
+			break;
+		}
+		psrc += 4;
+		n -= 4;
+	}
+	
 	while(n){
-		if(*psrc == c){
-			return (void *)psrc;
+		if(*psrc == find){
+			return (void*)psrc;
 		}
 		++psrc;
 		--n;
@@ -137,8 +441,23 @@ void *memchr(const void *src, char c, size_t n){
  * @return Negative if s1 < s2, 0 if s1 == s2, positive if s1 > s2.
  */
 int memcmp(const void *s1, const void *s2, size_t n){
-	const unsigned char *p1 = s1;
-	const unsigned char *p2 = s2;
+	const uint8_t *p1 = s1;
+	const uint8_t *p2 = s2;
+	if(n >= STRING_SSE_MIN && fpu_sse2()){
+		uint32_t mask = mem_compare_sse2(&p1, &p2, n >> 4);
+		if(mask != 0xFFFF){
+			uint32_t i = __builtin_ctz(~mask);
+			return p1[i] - p2[i];
+		}
+		n &= 15;
+	}
+	
+	// Both ranges are n bytes long, so word reads stay inside them.
+	while(n >= 4 && *(const uint32_t*)p1 == *(const uint32_t*)p2){
+		p1 += 4;
+		p2 += 4;
+		n -= 4;
+	}
 	while(n){
 		if(*p1 != *p2){
 			return *p1 - *p2;
@@ -177,14 +496,7 @@ char *strcat(char *restrict dest, const char *restrict src){
  * @return Negative if s1 < s2, 0 if s1 == s2, positive if s1 > s2.
  */
 int strcmp(const char *s1, const char *s2){
-	while(*s1 || *s2){
-		if(*s1 != *s2){
-			return *s1 - *s2;
-		}
-		++s1;
-		++s2;
-	}
-	return 0;
+	return strncmp(s1, s2, SIZE_MAX);
 }
 
 /**
@@ -195,12 +507,34 @@ int strcmp(const char *s1, const char *s2){
  * @return Negative if s1 < s2, 0 if s1 == s2, positive if s1 > s2.
  */
 int strncmp(const char *s1, const char *s2, size_t max){
-	while((*s1 || *s2) && max){
-		if(*s1 != *s2){
-			return *s1 - *s2;
+	const uint8_t *p1 = (const uint8_t*)s1;
+	const uint8_t *p2 = (const uint8_t*)s2;
+	if((((uint32_t)p1 ^ (uint32_t)p2) & 3) == 0){
+		// Equally aligned strings can be compared a word at a time.
+		while(max && ((uint32_t)p1 & 3)){
+			if(*p1 != *p2 || !*p1){
+				return *p1 - *p2;
+			}
+			++p1;
+			++p2;
+			--max;
+		}
+		while(max >= 4){
+			uint32_t w1 = *(const uint32_t*)p1;
+			if(w1 != *(const uint32_t*)p2 || STRING_HAS_ZERO(w1)){
+				break;
+			}
+			p1 += 4;
+			p2 += 4;
+			max -= 4;
+		}
+	}
+	while(max){
+		if(*p1 != *p2 || !*p1){
+			return *p1 - *p2;
 		}
-		++s1;
-		++s2;
+		++p1;
+		++p2;
 		--max;
 	}
 	return 0;
@@ -240,10 +574,44 @@ char *strcpy(char *restrict dest, const char *restrict src){
  * @return The length of the string.
  */
 size_t strlen(const char *str){
-	size_t len = 0;
-	while(str[len]){
-		++len;
+	const uint8_t *p = (const uint8_t*)str;
+	while((uint32_t)p & 3){
+		if(!*p){
+			return p - (const uint8_t*)str;
+		}
+		++p;
+	}
+	
+	size_t scanned = 0;
+	while(!STRING_HAS_ZERO(*(const uint32_t*)p)){
+		p += 4;
+		scanned += 4;
+		if(scanned >= STRING_SCAN_MIN && !((uint32_t)p & 15) && fpu_sse2()){
+			// Long string, the terminator is in some later block.
+			uint32_t mask = mem_find_sse2(&p, 0, SIZE_MAX >> 4);
+			return p + __builtin_ctz(mask) - (const uint8_t*)str;
+		}
+	}
+	while(*p){
+		++p;
 	}
-	return len;
+	return p - (const uint8_t*)str;
 }
 
+
+/**
+ * Finds the first occurence of a substring.
+ * @param str The string to search.
+ * @param sub The substring to find.
+ * @return A pointer to the substring in str, or NULL if not found.
+ */
+char *strstr(const char *str, const char *sub){
+	size_t len = strlen(sub);
+	while(*str){
+		if(strncmp(str, sub, len) == 0){
+			return (char*)str;
+		}
+		++str;
+	}
+	return (len == 0) ? (char*)str : NULL;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file lib/std/time.c
+ * Implementation of the C time functions.
+ * @author Conlan Wesson
+ */
+
+#include <time.h>
+
+#include <errno.h>
+#include <kernel/div.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sys/clock.h"
+
+#define TIME_SEC_PER_DAY  (86400)     //!< Seconds per day.
+#define TIME_EPOCH_DAYS   (719468)    //!< Days from 0000-03-01 to 1970-01-01.
+#define TIME_DAYS_PER_ERA (146097)    //!< Days per 400 year cycle.
+
+/**
+ * Counts the days from the epoch to a date.
+ * @param year The year, at least 1.
+ * @param month The month (1-12).
+ * @param day The day of the month (1-31).
+ * @return Days since 1970-01-01, negative before the epoch.
+ */
+static int32_t time_days(uint32_t year, uint32_t month, uint32_t day){
+	// Count from March so the leap day is at the end of the year.
+	year -= (month <= 2);
+	uint32_t era = year / 400;
+	uint32_t yoe = year - era*400;
+	uint32_t doy = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1;
+	uint32_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+	return (int32_t)(era*TIME_DAYS_PER_ERA + doe) - TIME_EPOCH_DAYS;
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *tp){
+	if(tp == NULL){
+		return EINVAL;
+	}
+	uint64_t ns;
+	switch(clock_id){
+		case CLOCK_REALTIME:
+			ns = clock_realtime_ns();
+			break;
+		case CLOCK_MONOTONIC:
+			ns = clock_ns();
+			break;
+		default:
+			return EINVAL;
+	}
+	tp->tv_nsec = div64_32(&ns, CLOCK_NS_PER_SEC);
+	tp->tv_sec = ns;
+	return EOK;
+}
+
+time_t time(time_t *tloc){
+	uint64_t now = clock_realtime_ns();
+	div64_32(&now, CLOCK_NS_PER_SEC);
+	if(tloc != NULL){
+		*tloc = now;
+	}
+	return now;
+}
+
+time_t mktime(struct tm *timeptr){
+	int year = timeptr->tm_year + 1900 + timeptr->tm_mon/12;
+	int month = timeptr->tm_mon % 12;
+	if(month < 0){
+		month += 12;
+		--year;
+	}
+	if(year < 1){
+		return (time_t)-1;
+	}
+	int64_t secs = (int64_t)time_days(year, month + 1, 1) * TIME_SEC_PER_DAY;
+	secs += (int64_t)(timeptr->tm_mday - 1) * TIME_SEC_PER_DAY;
+	secs += timeptr->tm_hour*3600 + timeptr->tm_min*60 + timeptr->tm_sec;
+	if(secs < 0){
+		return (time_t)-1;
+	}
+	time_t ret = secs;
+	gmtime_r(&ret, timeptr);
+	return ret;
+}
+
+struct tm *gmtime_r(const time_t *timer, struct tm *result){
+	uint64_t secs = *timer;
+	uint32_t rem = div64_32(&secs, TIME_SEC_PER_DAY);
+	uint32_t days = secs;
+	result->tm_sec = rem % 60;
+	result->tm_min = (rem / 60) % 60;
+	result->tm_hour = rem / 3600;
+	result->tm_wday = (days + 4) % 7;    // 1970-01-01 was a Thursday.
+	result->tm_isdst = 0;
+	
+	// Civil date from a day count starting in March.
+	uint32_t z = days + TIME_EPOCH_DAYS;
+	uint32_t era = z / TIME_DAYS_PER_ERA;
+	uint32_t doe = z - era*TIME_DAYS_PER_ERA;
+	uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+	uint32_t mp = (5*doy + 2)/153;
+	uint32_t month = (mp < 10) ? mp + 3 : mp - 9;
+	uint32_t year = yoe + era*400 + (month <= 2);
+	result->tm_mday = doy - (153*mp + 2)/5 + 1;
+	result->tm_mon = month - 1;
+	result->tm_year = year - 1900;
+	result->tm_yday = days - time_days(year, 1, 1);
+	return result;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file sys/arena.c
+ * Arena allocator for short lived data.
+ *
+ * An arena is a list of chunks of page frames.  Allocating bumps a pointer
+ * through the newest chunk and only takes new frames when it runs out.
+ * Nothing is freed individually, rolling back to a mark returns every chunk
+ * taken since the mark to the frame allocator at once.
+ * @author Conlan Wesson
+ */
+
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sys/frame.h"
+
+enum {
+	ARENA_ALIGN = 8    //!< Alignment of arena allocations.
+};
+
+/**
+ * Header at the start of each chunk.
+ */
+typedef struct arena_chunk{
+	struct arena_chunk *prev;    //!< Previous chunk in the arena.
+	uint32_t frames;             //!< Number of page frames in the chunk.
+} arena_chunk;
+
+/**
+ * Gets the first usable byte of a chunk.
+ * @param chunk The chunk.
+ * @return Pointer after the chunk header.
+ */
+static inline uint8_t *arena_chunk_start(arena_chunk *chunk){
+	return (uint8_t*)chunk + ((sizeof(arena_chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+}
+
+/**
+ * Gets the first usable byte after the arena state.
+ * @param a The arena.
+ * @return Pointer after the arena state.
+ */
+static inline uint8_t *arena_first(arena *a){
+	return (uint8_t*)a + ((sizeof(arena) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+}
+
+/**
+ * Allocates a chunk.
+ * @param prev The previous chunk.
+ * @param size Minimum number of usable bytes.
+ * @return The new chunk, or NULL if out of memory.
+ */
+static arena_chunk *arena_chunk_create(arena_chunk *prev, size_t size){
+	uint32_t frames = (size + sizeof(arena_chunk) + ARENA_ALIGN + FRAME_SIZE - 1) / FRAME_SIZE;
+	arena_chunk *chunk = (frames == 1) ? frame_alloc() : frame_alloc_contig(frames);
+	if(chunk){
+		chunk->prev = prev;
+		chunk->frames = frames;
+	}
+	return chunk;
+}
+
+/**
+ * Frees a chunk.
+ * @param chunk The chunk.
+ */
+static inline void arena_chunk_free(arena_chunk *chunk){
+	frame_free_contig(chunk, chunk->frames);
+}
+
+/**
+ * Creates an arena.
+ * The arena state lives in its own first page frame.
+ * @return The new arena, or NULL if out of memory.
+ */
+arena *arena_create(){
+	arena_chunk *chunk = arena_chunk_create(NULL, sizeof(arena));
+	if(chunk == NULL){
+		return NULL;
+	}
+	arena *a = (arena*)arena_chunk_start(chunk);
+	a->chunk = chunk;
+	a->next = arena_first(a);
+	a->end = (uint8_t*)chunk + chunk->frames*FRAME_SIZE;
+	return a;
+}
+
+/**
+ * Allocates space from an arena.
+ * @param a The arena.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the 8 byte aligned space, or NULL if out of memory.
+ */
+void *arena_alloc(arena *a, size_t size){
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if(size > (size_t)(a->end - a->next)){
+		arena_chunk *chunk = arena_chunk_create(a->chunk, size);
+		if(chunk == NULL){
+			return NULL;
+		}
+		a->chunk = chunk;
+		a->next = arena_chunk_start(chunk);
+		a->end = (uint8_t*)chunk + chunk->frames*FRAME_SIZE;
+	}
+	void *ptr = a->next;
+	a->next += size;
+	return ptr;
+}
+
+/**
+ * Saves the current position of an arena.
+ * @param a The arena.
+ * @return Mark to pass to arena_rollback().
+ */
+arena_mark arena_checkpoint(const arena *a){
+	arena_mark mark = {a->chunk, a->next};
+	return mark;
+}
+
+/**
+ * Frees everything allocated from an arena since a checkpoint.
+ * @param a The arena.
+ * @param mark Mark returned by arena_checkpoint().
+ */
+void arena_rollback(arena *a, arena_mark mark){
+	while(a->chunk != mark.chunk){
+		arena_chunk *prev = a->chunk->prev;
+		arena_chunk_free(a->chunk);
+		a->chunk = prev;
+	}
+	a->next = mark.next;
+	a->end = (uint8_t*)a->chunk + a->chunk->frames*FRAME_SIZE;
+}
+
+/**
+ * Frees everything allocated from an arena, keeping the arena.
+ * @param a The arena.
+ */
+void arena_reset(arena *a){
+	arena_chunk *first = a->chunk;
+	while(first->prev){
+		first = first->prev;
+	}
+	arena_mark mark = {first, arena_first(a)};
+	arena_rollback(a, mark);
+}
+
+/**
+ * Frees an arena and everything allocated from it.
+ * @param a The arena.
+ */
+void arena_release(arena *a){
+	arena_chunk *chunk = a->chunk;
+	while(chunk){
+		arena_chunk *prev = chunk->prev;
+		arena_chunk_free(chunk);
+		chunk = prev;
+	}
+}
@@ -0,0 +1,73 @@
+/**
+ * @file sys/arena.h
+ * Arena allocator for short lived data.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_ARENA_H_
+#define __SYS_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct arena_chunk;
+
+/**
+ * Arena allocator state.
+ */
+typedef struct arena{
+	struct arena_chunk *chunk;    //!< Newest chunk of page frames.
+	uint8_t *next;                //!< Next free byte in the newest chunk.
+	uint8_t *end;                 //!< End of the newest chunk.
+} arena;
+
+/**
+ * Saved arena position.
+ */
+typedef struct arena_mark{
+	struct arena_chunk *chunk;    //!< Newest chunk when the mark was taken.
+	uint8_t *next;                //!< Next free byte when the mark was taken.
+} arena_mark;
+
+/**
+ * Creates an arena.
+ * The arena state lives in its own first page frame.
+ * @return The new arena, or NULL if out of memory.
+ */
+arena *arena_create();
+
+/**
+ * Allocates space from an arena.
+ * @param a The arena.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the 8 byte aligned space, or NULL if out of memory.
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * Saves the current position of an arena.
+ * @param a The arena.
+ * @return Mark to pass to arena_rollback().
+ */
+arena_mark arena_checkpoint(const arena *a);
+
+/**
+ * Frees everything allocated from an arena since a checkpoint.
+ * @param a The arena.
+ * @param mark Mark returned by arena_checkpoint().
+ */
+void arena_rollback(arena *a, arena_mark mark);
+
+/**
+ * Frees everything allocated from an arena, keeping the arena.
+ * @param a The arena.
+ */
+void arena_reset(arena *a);
+
+/**
+ * Frees an arena and everything allocated from it.
+ * @param a The arena.
+ */
+void arena_release(arena *a);
+
+#endif /* __SYS_ARENA_H_ */
@@ -0,0 +1,354 @@
+/**
+ * @file sys/clock.c
+ * Monotonic clock and one-shot clock events.
+ *
+ * Events wait in a queue sorted by expiry time.  The local APIC timer is
+ * programmed in one-shot mode for the first event only, so an idle CPU
+ * sleeps until there is something to do instead of taking a periodic tick.
+ * With nothing queued the timer still expires every few seconds so its
+ * count does not run out.  The PIT is only used to calibrate the APIC timer,
+ * or as a periodic fallback when there is no APIC.
+ *
+ * The time is read from the best source available.  An invariant time stamp
+ * counter runs at a constant rate in every power state, so it is read
+ * directly without disabling interrupts.  Otherwise the time is kept as the
+ * nanoseconds up to when the APIC timer was last programmed plus the counts
+ * elapsed since, or as the PIT tick count.  Both counters are calibrated
+ * against PIT Channel 2 and converted with a multiply and shift, the kernel
+ * has no 64bit division.
+ *
+ * The wall clock is the RTC read once during clock_init() plus the
+ * monotonic time since, so reading it never touches the CMOS.
+ * @author Conlan Wesson
+ */
+
+#include "clock.h"
+
+#include <errno.h>
+#include <kernel/cpuid.h>
+#include <kernel/int.h>
+#include <kernel/tsc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "dev/pit.h"
+#include "dev/rtc.h"
+#include "sys/interrupt/apic.h"
+#include "sys/interrupt/isr.h"
+
+#define CLOCK_PIT_FREQ 1000                                     //!< Fallback PIT tick rate.
+#define CLOCK_PIT_NS   (CLOCK_NS_PER_SEC / CLOCK_PIT_FREQ)      //!< Nanoseconds per fallback tick.
+#define CLOCK_MAX_NS   4000000000u                              //!< Longest time programmed at once.
+#define CLOCK_TSC_US   10000                                    //!< Length of each TSC calibration run.
+#define CLOCK_TSC_RUNS 3                                        //!< Number of TSC calibration runs.
+
+/**
+ * Sources of monotonic time, best first.
+ */
+enum clock_source{
+	CLOCK_SOURCE_TSC,     //!< Invariant time stamp counter.
+	CLOCK_SOURCE_APIC,    //!< Local APIC timer count.
+	CLOCK_SOURCE_PIT      //!< PIT Channel 0 tick count.
+};
+
+static clock_event *queue = NULL;                   //!< Pending events, earliest first.
+static bool running = false;                        //!< Clock has been started.
+static bool oneshot = false;                        //!< Using the local APIC timer rather than the PIT.
+static enum clock_source source = CLOCK_SOURCE_PIT; //!< Where the time is read from.
+static uint64_t base_ns = 0;                        //!< Time when the timer was last programmed.
+static uint32_t programmed = 0;                     //!< Counts the timer was last programmed with.
+static uint32_t ns_mult = 0;                        //!< Counts to nanoseconds multiplier.
+static uint32_t ns_shift = 0;                       //!< Counts to nanoseconds shift.
+static uint32_t count_mult = 0;                     //!< Nanoseconds to counts multiplier, shifted by 32.
+static uint32_t max_ns = 0;                         //!< Longest time the timer can be programmed for.
+static uint64_t tsc_base = 0;                       //!< Time stamp counter at clock_init().
+static uint32_t tsc_mult = 0;                       //!< Cycles to nanoseconds multiplier.
+static uint32_t tsc_shift = 0;                      //!< Cycles to nanoseconds shift.
+static uint64_t realtime_base = 0;                  //!< Nanoseconds since the epoch at clock_init().
+
+/**
+ * Converts a count to nanoseconds.
+ * @param value The count.
+ * @param mult Multiplier from clock_factor().
+ * @param shift Shift from clock_factor(), at most 32.
+ * @return (value * mult) >> shift, without overflowing 64 bits.
+ */
+static inline uint64_t clock_scale(uint64_t value, uint32_t mult, uint32_t shift){
+	uint64_t lo = ((uint64_t)(uint32_t)value * mult) >> shift;
+	uint64_t hi = (uint64_t)(uint32_t)(value >> 32) * mult;
+	return lo + (hi << (32 - shift));
+}
+
+/**
+ * Finds the multiplier and shift for converting a count to nanoseconds.
+ * Picks the largest shift whose multiplier still fits in 32 bits.
+ * @param freq Frequency of the counter in Hz.
+ * @param mult Set to the multiplier.
+ * @param shift Set to the shift.
+ */
+static void clock_factor(uint64_t freq, uint32_t *mult, uint32_t *shift){
+	double ns_per_count = (double)CLOCK_NS_PER_SEC / (double)(int64_t)freq;
+	*shift = 32;
+	while(*shift && ns_per_count * (double)(1ull << *shift) >= 4294967296.0){
+		--*shift;
+	}
+	*mult = (int64_t)(ns_per_count * (double)(1ull << *shift));
+}
+
+/**
+ * Reads the time stamp counter clock.
+ * Safe to call with interrupts enabled.
+ * @return Nanoseconds since clock_init().
+ */
+static inline uint64_t clock_tsc(){
+	return clock_scale(rdtsc() - tsc_base, tsc_mult, tsc_shift);
+}
+
+/**
+ * Calibrates the time stamp counter against PIT Channel 2.
+ * The counter is only used if it is invariant, otherwise its rate follows
+ * the processor's power state.  The shortest of several runs is kept, since
+ * an interrupt from firmware can only make a run longer.
+ * @return Frequency in Hz, or zero if the counter can not be used.
+ */
+static uint64_t clock_tsc_calibrate(){
+	if(!(cpuid(0x00000001).edx & (1 << 4))){
+		return 0;
+	}
+	if((uint32_t)cpuid(0x80000000).eax < 0x80000007 || !(cpuid(0x80000007).edx & (1 << 8))){
+		return 0;
+	}
+	uint64_t best = UINT64_MAX;
+	uint32_t flags = int_save();
+	for(int i = 0; i < CLOCK_TSC_RUNS; ++i){
+		uint64_t start = rdtsc();
+		pit_delay(CLOCK_TSC_US);
+		uint64_t elapsed = rdtsc() - start;
+		if(elapsed < best){
+			best = elapsed;
+		}
+	}
+	int_restore(flags);
+	return best * (1000000 / CLOCK_TSC_US);
+}
+
+/**
+ * Reads the monotonic time.
+ * Must be called with interrupts disabled.
+ * @return Nanoseconds since clock_init().
+ */
+static uint64_t clock_read(){
+	switch(source){
+		case CLOCK_SOURCE_TSC:
+			return clock_tsc();
+		case CLOCK_SOURCE_APIC:{
+			uint32_t elapsed = programmed - apic_timer_remaining();
+			return base_ns + clock_scale(elapsed, ns_mult, ns_shift);
+		}
+		case CLOCK_SOURCE_PIT:
+		default:
+			return pit_ticks() * CLOCK_PIT_NS;
+	}
+}
+
+/**
+ * Programs the local APIC timer for the first queued event.
+ * Must be called with interrupts disabled.
+ */
+static void clock_program(){
+	uint64_t now = clock_read();
+	uint32_t delta = max_ns;
+	if(queue){
+		if(queue->expires <= now){
+			delta = 0;
+		}else if(queue->expires - now < max_ns){
+			delta = queue->expires - now;
+		}
+	}
+	uint32_t counts = ((uint64_t)delta * count_mult) >> 32;
+	base_ns = now;
+	programmed = counts ? counts : 1;
+	apic_timer_oneshot(programmed);
+}
+
+/**
+ * Runs every expired event.
+ * Must be called with interrupts disabled.
+ */
+static void clock_dispatch(){
+	uint64_t now = clock_read();
+	while(queue && queue->expires <= now){
+		clock_event *event = queue;
+		queue = event->next;
+		event->next = NULL;
+		event->queued = false;
+		event->handler(event);
+		now = clock_read();
+	}
+}
+
+/**
+ * Local APIC timer interrupt handler.
+ * @param regs Registers from before the interrupt.
+ */
+static void clock_isr(isr_regs regs){
+	(void)regs;
+	clock_dispatch();
+	clock_program();
+}
+
+/**
+ * Fallback PIT tick hook.
+ */
+static void clock_tick(){
+	clock_dispatch();
+}
+
+/**
+ * Starts the clock.
+ * The local APIC timer is calibrated against the PIT and programmed one
+ * event at a time.  Without an APIC the PIT ticks periodically instead.
+ * An invariant time stamp counter is used for the time if there is one.
+ * Must be called after apic_init().
+ * @return Error code, or EOK if successful.
+ */
+int clock_init(){
+	if(running){
+		return EALREADY;
+	}
+	uint64_t tsc_freq = clock_tsc_calibrate();
+	if(tsc_freq){
+		clock_factor(tsc_freq, &tsc_mult, &tsc_shift);
+	}
+	
+	uint32_t flags;
+	uint32_t freq = apic_timer_init();
+	if(freq > 0 && (uint64_t)freq < CLOCK_NS_PER_SEC){
+		clock_factor(freq, &ns_mult, &ns_shift);
+		count_mult = (int64_t)(4294967296.0 * (double)freq / 1e9);
+		uint64_t limit = ((uint64_t)0xFFFFFFFF * ns_mult) >> ns_shift;
+		max_ns = (limit < CLOCK_MAX_NS) ? limit : CLOCK_MAX_NS;
+		
+		isr_register(ISR_APIC_TIMER, &clock_isr);
+		flags = int_save();
+		oneshot = true;
+		source = CLOCK_SOURCE_APIC;
+	}else{
+		pit_init(CLOCK_PIT_FREQ);
+		int ret = pit_add_hook(clock_tick, 1);
+		if(ret != EOK){
+			return ret;
+		}
+		flags = int_save();
+		source = CLOCK_SOURCE_PIT;
+	}
+	if(tsc_freq){
+		source = CLOCK_SOURCE_TSC;
+	}
+	tsc_base = rdtsc();
+	running = true;
+	if(oneshot){
+		clock_program();
+	}
+	int_restore(flags);
+	
+	// One slow read of the CMOS, the wall clock follows the monotonic time from here.
+	struct tm dt;
+	time_t now = mktime(rtc_time(&dt));
+	if(now != (time_t)-1){
+		realtime_base = now * CLOCK_NS_PER_SEC - clock_ns();
+	}
+	return EOK;
+}
+
+/**
+ * Checks if the clock has been started.
+ * @return true if clock events will run.
+ */
+bool clock_running(){
+	return running;
+}
+
+/**
+ * Gets the monotonic time.
+ * Cheap enough for benchmarks when the time stamp counter is used.
+ * @return Nanoseconds since clock_init().
+ */
+uint64_t clock_ns(){
+	if(!running){
+		return 0;
+	}
+	if(source == CLOCK_SOURCE_TSC){
+		return clock_tsc();
+	}
+	uint32_t flags = int_save();
+	uint64_t now = clock_read();
+	int_restore(flags);
+	return now;
+}
+
+/**
+ * Gets the wall clock time.
+ * @return Nanoseconds since the Unix epoch, UTC.
+ */
+uint64_t clock_realtime_ns(){
+	return realtime_base + clock_ns();
+}
+
+/**
+ * Unlinks an event from the queue.
+ * Must be called with interrupts disabled.
+ * @param event The event.
+ * @return true if the event was queued.
+ */
+static bool clock_unlink(clock_event *event){
+	if(!event->queued){
+		return false;
+	}
+	for(clock_event **link = &queue; *link; link = &(*link)->next){
+		if(*link == event){
+			*link = event->next;
+			break;
+		}
+	}
+	event->next = NULL;
+	event->queued = false;
+	return true;
+}
+
+/**
+ * Queues an event, moving it if it is already queued.
+ * Events may be added before clock_init(), they run once it starts.
+ * @param event The event, with handler set.
+ * @param expires Monotonic time to run at, in nanoseconds.
+ */
+void clock_event_add(clock_event *event, uint64_t expires){
+	uint32_t flags = int_save();
+	clock_unlink(event);
+	event->expires = expires;
+	clock_event **link = &queue;
+	while(*link && (*link)->expires <= expires){
+		link = &(*link)->next;
+	}
+	event->next = *link;
+	event->queued = true;
+	*link = event;
+	if(oneshot && queue == event){
+		// New first event, wake up in time for it.
+		clock_program();
+	}
+	int_restore(flags);
+}
+
+/**
+ * Removes an event from the queue.
+ * @param event The event.
+ * @return true if the event was queued.
+ */
+bool clock_event_remove(clock_event *event){
+	uint32_t flags = int_save();
+	bool ret = clock_unlink(event);
+	int_restore(flags);
+	return ret;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file sys/clock.h
+ * Monotonic clock and one-shot clock events.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_CLOCK_H_
+#define __SYS_CLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLOCK_NS_PER_SEC 1000000000ull    //!< Nanoseconds per second.
+
+typedef struct clock_event clock_event;
+
+/**
+ * Function called from the timer interrupt when a clock event expires.
+ * @param event The expired event, which may be added again.
+ */
+typedef void (*clock_handler)(clock_event *event);
+
+/**
+ * An event to run at a point in time.
+ */
+struct clock_event{
+	uint64_t expires;         //!< Monotonic time to run at, in nanoseconds.
+	clock_handler handler;    //!< Function to call.
+	clock_event *next;        //!< Next event in the queue.
+	bool queued;              //!< Event is waiting in the queue.
+};
+
+/**
+ * Starts the clock.
+ * The local APIC timer is calibrated against the PIT and programmed one
+ * event at a time.  Without an APIC the PIT ticks periodically instead.
+ * An invariant time stamp counter is used for the time if there is one.
+ * Must be called after apic_init().
+ * @return Error code, or EOK if successful.
+ */
+int clock_init();
+
+/**
+ * Checks if the clock has been started.
+ * @return true if clock events will run.
+ */
+bool clock_running();
+
+/**
+ * Gets the monotonic time.
+ * Cheap enough for benchmarks when the time stamp counter is used.
+ * @return Nanoseconds since clock_init().
+ */
+uint64_t clock_ns();
+
+/**
+ * Gets the wall clock time.
+ * The RTC is read once by clock_init(), later reads add the monotonic time.
+ * @return Nanoseconds since the Unix epoch, UTC.
+ */
+uint64_t clock_realtime_ns();
+
+/**
+ * Queues an event, moving it if it is already queued.
+ * Events may be added before clock_init(), they run once it starts.
+ * @param event The event, with handler set.
+ * @param expires Monotonic time to run at, in nanoseconds.
+ */
+void clock_event_add(clock_event *event, uint64_t expires);
+
+/**
+ * Removes an event from the queue.
+ * @param event The event.
+ * @return true if the event was queued.
+ */
+bool clock_event_remove(clock_event *event);
+
+#endif /* __SYS_CLOCK_H_ */
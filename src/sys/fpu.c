@@ -0,0 +1,80 @@
+/**
+ * @file sys/fpu.c
+ * Functions for enabling the FPU and SSE.
+ * @author Conlan Wesson
+ */
+
+#include "fpu.h"
+
+#include <kernel/cpuid.h>
+#include <stdbool.h>
+
+enum {
+	FPU_CPUID_FXSR = (1 << 24),    //!< CPUID EDX flag for FXSAVE and FXRSTOR.
+	FPU_CPUID_SSE  = (1 << 25),    //!< CPUID EDX flag for SSE.
+	FPU_CPUID_SSE2 = (1 << 26)     //!< CPUID EDX flag for SSE2.
+};
+
+static bool sse2 = false;    //!< SSE2 is enabled.
+static bool fxsr = false;    //!< FXSAVE and FXRSTOR are enabled.
+
+/**
+ * Enables the FPU, and SSE if the processor supports it.
+ */
+void fpu_init(){
+	// Clear EM, set MP and NE, then reset the FPU.
+	asm volatile(
+		"movl %%cr0, %%eax;"
+		"andl $~0x04, %%eax;"
+		"orl $0x22, %%eax;"
+		"movl %%eax, %%cr0;"
+		"fninit"
+		::: "eax"
+	);
+	
+	struct cpuid_out out = cpuid(0x00000001);
+	if((out.edx & FPU_CPUID_FXSR) && (out.edx & FPU_CPUID_SSE)){
+		// Set OSFXSR and OSXMMEXCPT.
+		asm volatile(
+			"movl %%cr4, %%eax;"
+			"orl $0x600, %%eax;"
+			"movl %%eax, %%cr4"
+			::: "eax"
+		);
+		fxsr = true;
+		sse2 = (out.edx & FPU_CPUID_SSE2) != 0;
+	}
+}
+
+/**
+ * Checks if SSE2 instructions may be used.
+ * @return true once fpu_init() has enabled SSE on a processor with SSE2.
+ */
+bool fpu_sse2(){
+	return sse2;
+}
+
+/**
+ * Saves the FPU and SSE registers.
+ * The FPU is left in an unknown state.
+ * @param state Where to save the registers.
+ */
+void fpu_save(fpu_state *state){
+	if(fxsr){
+		asm volatile("fxsave %0" : "=m"(*state));
+	}else{
+		asm volatile("fnsave %0" : "=m"(*state));
+	}
+}
+
+/**
+ * Restores FPU and SSE registers saved by fpu_save().
+ * @param state The saved registers.
+ */
+void fpu_restore(const fpu_state *state){
+	if(fxsr){
+		asm volatile("fxrstor %0" :: "m"(*state));
+	}else{
+		asm volatile("frstor %0" :: "m"(*state));
+	}
+}
@@ -0,0 +1,44 @@
+/**
+ * @file sys/fpu.h
+ * Functions for enabling the FPU and SSE.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_FPU_H_
+#define __SYS_FPU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Saved FPU and SSE registers.
+ */
+typedef struct fpu_state{
+	uint8_t data[512];    //!< FXSAVE image, or FSAVE image without SSE.
+} __attribute__((aligned(16))) fpu_state;
+
+/**
+ * Enables the FPU, and SSE if the processor supports it.
+ */
+void fpu_init();
+
+/**
+ * Checks if SSE2 instructions may be used.
+ * @return true once fpu_init() has enabled SSE on a processor with SSE2.
+ */
+bool fpu_sse2();
+
+/**
+ * Saves the FPU and SSE registers.
+ * The FPU is left in an unknown state.
+ * @param state Where to save the registers.
+ */
+void fpu_save(fpu_state *state);
+
+/**
+ * Restores FPU and SSE registers saved by fpu_save().
+ * @param state The saved registers.
+ */
+void fpu_restore(const fpu_state *state);
+
+#endif /* __SYS_FPU_H_ */
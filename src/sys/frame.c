@@ -0,0 +1,315 @@
+/**
+ * @file sys/frame.c
+ * Physical page frame allocator.
+ *
+ * Free frames are tracked in a hierarchical bitmap.  Level 0 has one bit per
+ * frame, each higher level has one bit per word of the level below which is
+ * set while that word has any free frame in it.  Allocating or freeing a
+ * frame touches at most one word per level, so the cost is bounded by
+ * FRAME_LEVELS no matter how much RAM is installed.
+ *
+ * The bitmap is only changed with interrupts disabled, so threads may
+ * allocate and free frames while being preempted.
+ * @author Conlan Wesson
+ */
+
+#include "frame.h"
+
+#include <errno.h>
+#include <kernel/int.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "dev/ram.h"
+
+enum {
+	FRAME_BITS   = 32,    //!< Number of bits per bitmap word.
+	FRAME_SHIFT  = 5,     //!< log2(FRAME_BITS).
+	FRAME_LEVELS = 4      //!< Bitmap levels, enough for 32^4 frames (4GiB).
+};
+
+#define FRAME_ADDR_MAX 0x100000000ull    //!< Only the 32bit address space is managed.
+
+static uint32_t *frame_map[FRAME_LEVELS];      //!< Bitmap levels, set bits mark free frames.
+static uint32_t frame_words[FRAME_LEVELS];     //!< Number of words in each bitmap level.
+static uint32_t frame_limit = 0;               //!< Number of frames covered by the bitmap.
+static uint32_t frame_total = 0;               //!< Number of usable frames.
+static uint32_t frame_available = 0;           //!< Number of free frames.
+
+/**
+ * Checks if a frame is free.
+ * @param frame The frame number.
+ * @return true if the frame is free.
+ */
+static inline bool frame_is_free(uint32_t frame){
+	return (frame_map[0][frame >> FRAME_SHIFT] >> (frame & (FRAME_BITS-1))) & 1;
+}
+
+/**
+ * Marks a frame as free in every bitmap level.
+ * @param frame The frame number.
+ */
+static void frame_set(uint32_t frame){
+	for(int level = 0; level < FRAME_LEVELS; ++level){
+		uint32_t word = frame >> FRAME_SHIFT;
+		bool was_empty = (frame_map[level][word] == 0);
+		frame_map[level][word] |= (1u << (frame & (FRAME_BITS-1)));
+		if(!was_empty){
+			// Higher levels already show free frames here.
+			break;
+		}
+		frame = word;
+	}
+}
+
+/**
+ * Marks a frame as used in every bitmap level.
+ * @param frame The frame number.
+ */
+static void frame_clear(uint32_t frame){
+	for(int level = 0; level < FRAME_LEVELS; ++level){
+		uint32_t word = frame >> FRAME_SHIFT;
+		frame_map[level][word] &= ~(1u << (frame & (FRAME_BITS-1)));
+		if(frame_map[level][word] != 0){
+			// Other frames in this word are still free.
+			break;
+		}
+		frame = word;
+	}
+}
+
+/**
+ * Marks a range of memory as unavailable.
+ * @param start Start address of the range, rounded down to a frame.
+ * @param end End address of the range, rounded up to a frame.
+ */
+static void frame_reserve(uint64_t start, uint64_t end){
+	uint64_t first = start / FRAME_SIZE;
+	uint64_t last = (end + FRAME_SIZE - 1) / FRAME_SIZE;
+	if(last > frame_limit){
+		last = frame_limit;
+	}
+	for(uint64_t frame = first; frame < last; ++frame){
+		if(frame_is_free(frame)){
+			frame_clear(frame);
+			--frame_total;
+			--frame_available;
+		}
+	}
+}
+
+/**
+ * Advances to the next entry in the memory map.
+ * @param mmap Current memory map entry.
+ * @return The next memory map entry.
+ */
+static inline struct mmap_entry *frame_next_entry(struct mmap_entry *mmap){
+	return (struct mmap_entry*)((uint32_t)mmap + mmap->size + sizeof(uint32_t));
+}
+
+/**
+ * Builds the frame bitmap from the multiboot memory map.
+ * Must be called after ram_init().
+ * @return Error code, or EOK if successful.
+ */
+int frame_init(){
+	struct mmap_entry *const first = ram_mmap();
+	const uint32_t end_map = (uint32_t)first + ram_mmap_length();
+	const uint64_t begin = ((uint32_t)ram_kernel_end() + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+	
+	// Find the highest usable address.
+	uint64_t top = 0;
+	for(struct mmap_entry *mmap = first; (uint32_t)mmap < end_map; mmap = frame_next_entry(mmap)){
+		uint64_t end = mmap->addr + mmap->len;
+		if(mmap->type == RAM_BLOCK_USABLE && end > top){
+			top = end;
+		}
+	}
+	if(top > FRAME_ADDR_MAX){
+		top = FRAME_ADDR_MAX;
+	}
+	frame_limit = top / FRAME_SIZE;
+	if(frame_limit == 0){
+		return ENOMEM;
+	}
+	
+	// Size each bitmap level.
+	uint32_t bytes = 0;
+	uint32_t count = frame_limit;
+	for(int level = 0; level < FRAME_LEVELS; ++level){
+		frame_words[level] = (count + FRAME_BITS - 1) / FRAME_BITS;
+		bytes += frame_words[level] * sizeof(uint32_t);
+		count = frame_words[level];
+	}
+	
+	// Place the bitmap in the first usable block above the kernel.
+	uint64_t store = 0;
+	for(struct mmap_entry *mmap = first; (uint32_t)mmap < end_map && !store; mmap = frame_next_entry(mmap)){
+		if(mmap->type != RAM_BLOCK_USABLE){
+			continue;
+		}
+		uint64_t start = (mmap->addr + FRAME_SIZE - 1) & ~(uint64_t)(FRAME_SIZE - 1);
+		if(start < begin){
+			start = begin;
+		}
+		if(start + bytes <= mmap->addr + mmap->len && start + bytes <= top){
+			store = start;
+		}
+	}
+	if(!store){
+		return ENOMEM;
+	}
+	
+	uint32_t *words = (uint32_t*)(uint32_t)store;
+	memset(words, 0, bytes);
+	for(int level = 0; level < FRAME_LEVELS; ++level){
+		frame_map[level] = words;
+		words += frame_words[level];
+	}
+	
+	// Free every whole frame of usable memory.
+	frame_total = 0;
+	for(struct mmap_entry *mmap = first; (uint32_t)mmap < end_map; mmap = frame_next_entry(mmap)){
+		if(mmap->type != RAM_BLOCK_USABLE){
+			continue;
+		}
+		uint64_t start = (mmap->addr + FRAME_SIZE - 1) / FRAME_SIZE;
+		uint64_t end = (mmap->addr + mmap->len) / FRAME_SIZE;
+		if(end > frame_limit){
+			end = frame_limit;
+		}
+		for(uint64_t frame = start; frame < end; ++frame){
+			if(!frame_is_free(frame)){
+				frame_set(frame);
+				++frame_total;
+			}
+		}
+	}
+	frame_available = frame_total;
+	
+	// Reserved blocks may overlap usable ones, they take precedence.
+	for(struct mmap_entry *mmap = first; (uint32_t)mmap < end_map; mmap = frame_next_entry(mmap)){
+		if(mmap->type != RAM_BLOCK_USABLE && mmap->addr < top){
+			frame_reserve(mmap->addr, mmap->addr + mmap->len);
+		}
+	}
+	// Keep the kernel image and the bitmap itself.
+	frame_reserve(0, begin);
+	frame_reserve(store, store + bytes);
+	
+	return EOK;
+}
+
+/**
+ * Allocates a single physical page frame.
+ * @return Address of the frame, or NULL if no memory is available.
+ */
+void *frame_alloc(){
+	uint32_t flags = int_save();
+	if(frame_limit == 0 || frame_map[FRAME_LEVELS-1][0] == 0){
+		int_restore(flags);
+		return NULL;
+	}
+	
+	// Follow the first set bit down from the top level.
+	uint32_t frame = 0;
+	for(int level = FRAME_LEVELS-1; level >= 0; --level){
+		frame = (frame << FRAME_SHIFT) + __builtin_ctz(frame_map[level][frame]);
+	}
+	
+	frame_clear(frame);
+	--frame_available;
+	int_restore(flags);
+	return (void*)(frame * FRAME_SIZE);
+}
+
+/**
+ * Allocates physically contiguous page frames.
+ * This scans the bitmap linearly, use frame_alloc() where possible.
+ * @param count Number of frames to allocate.
+ * @return Address of the first frame, or NULL if no run is available.
+ */
+void *frame_alloc_contig(uint32_t count){
+	uint32_t flags = int_save();
+	if(count == 0 || count > frame_available){
+		int_restore(flags);
+		return NULL;
+	}
+	
+	void *ret = NULL;
+	uint32_t run = 0;
+	for(uint32_t frame = 0; frame < frame_limit; ++frame){
+		if(run == 0 && (frame & (FRAME_BITS-1)) == 0 && frame_map[0][frame >> FRAME_SHIFT] == 0){
+			// Skip whole words of used frames.
+			frame += FRAME_BITS - 1;
+			continue;
+		}
+		if(!frame_is_free(frame)){
+			run = 0;
+			continue;
+		}
+		++run;
+		if(run == count){
+			uint32_t start = frame + 1 - count;
+			for(uint32_t i = start; i <= frame; ++i){
+				frame_clear(i);
+			}
+			frame_available -= count;
+			ret = (void*)(start * FRAME_SIZE);
+			break;
+		}
+	}
+	int_restore(flags);
+	return ret;
+}
+
+/**
+ * Returns a page frame to the allocator.
+ * @param frame Address of the frame to free.
+ * @return Error code, or EOK if successful.
+ */
+int frame_free(void *frame){
+	return frame_free_contig(frame, 1);
+}
+
+/**
+ * Returns physically contiguous page frames to the allocator.
+ * @param frame Address of the first frame to free.
+ * @param count Number of frames to free.
+ * @return Error code, or EOK if successful.
+ */
+int frame_free_contig(void *frame, uint32_t count){
+	uint32_t start = (uint32_t)frame / FRAME_SIZE;
+	if((uint32_t)frame & (FRAME_SIZE - 1) || start + count > frame_limit || start + count < start){
+		return EFAULT;
+	}
+	uint32_t flags = int_save();
+	for(uint32_t i = start; i < start + count; ++i){
+		if(frame_is_free(i)){
+			int_restore(flags);
+			return EALREADY;
+		}
+	}
+	for(uint32_t i = start; i < start + count; ++i){
+		frame_set(i);
+	}
+	frame_available += count;
+	int_restore(flags);
+	return EOK;
+}
+
+/**
+ * Returns the number of free page frames.
+ * @return Number of free frames.
+ */
+uint32_t frame_count_free(){
+	return frame_available;
+}
+
+/**
+ * Returns the number of page frames managed by the allocator.
+ * @return Number of usable frames.
+ */
+uint32_t frame_count_total(){
+	return frame_total;
+}
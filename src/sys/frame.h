@@ -0,0 +1,62 @@
+/**
+ * @file sys/frame.h
+ * Physical page frame allocator.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_FRAME_H_
+#define __SYS_FRAME_H_
+
+#include <stdint.h>
+
+#define FRAME_SIZE 0x1000u    //!< Size of a physical page frame in bytes.
+
+/**
+ * Builds the frame bitmap from the multiboot memory map.
+ * Must be called after ram_init().
+ * @return Error code, or EOK if successful.
+ */
+int frame_init();
+
+/**
+ * Allocates a single physical page frame.
+ * @return Address of the frame, or NULL if no memory is available.
+ */
+void *frame_alloc();
+
+/**
+ * Allocates physically contiguous page frames.
+ * This scans the bitmap linearly, use frame_alloc() where possible.
+ * @param count Number of frames to allocate.
+ * @return Address of the first frame, or NULL if no run is available.
+ */
+void *frame_alloc_contig(uint32_t count);
+
+/**
+ * Returns a page frame to the allocator.
+ * @param frame Address of the frame to free.
+ * @return Error code, or EOK if successful.
+ */
+int frame_free(void *frame);
+
+/**
+ * Returns physically contiguous page frames to the allocator.
+ * @param frame Address of the first frame to free.
+ * @param count Number of frames to free.
+ * @return Error code, or EOK if successful.
+ */
+int frame_free_contig(void *frame, uint32_t count);
+
+/**
+ * Returns the number of free page frames.
+ * @return Number of free frames.
+ */
+uint32_t frame_count_free();
+
+/**
+ * Returns the number of page frames managed by the allocator.
+ * @return Number of usable frames.
+ */
+uint32_t frame_count_total();
+
+#endif /* __SYS_FRAME_H_ */
@@ -0,0 +1,385 @@
+/**
+ * @file interrupt/apic.c
+ * Local APIC and I/O APIC interrupt controllers.
+ *
+ * The ISA IRQs are routed through the I/O APICs to the same vectors the PICs
+ * used, IRQ0 to IRQ15, so handlers do not change.  Each line stays masked
+ * until a handler is registered for it.  Acknowledging an interrupt is then
+ * a single store to the memory mapped local APIC instead of one or two port
+ * writes to the PICs.
+ * @author Conlan Wesson
+ */
+
+#include "apic.h"
+
+#include <errno.h>
+#include <kernel/cpuid.h>
+#include <kernel/int.h>
+#include <kernel/ioport.h>
+#include <kernel/msr.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "isr.h"
+#include "dev/madt.h"
+#include "dev/pit.h"
+#include "dev/sdt.h"
+#include "sys/paging.h"
+
+#define APIC_BASE_MSR  0x1B          //!< APIC MSR number.
+#define APIC_ENABLE    0x800         //!< APIC enable bit.
+#define APIC_BASE_MASK 0xFFFFF000    //!< Address bits of the APIC MSR.
+
+#define APIC_MAX_IOAPICS 4    //!< Most I/O APICs handled.
+#define APIC_ISA_IRQS    16   //!< Number of ISA IRQs.
+
+//! Local APIC register offsets, in 32bit words.
+enum {
+	LAPIC_ID          = 0x020 / 4,    //!< Local APIC ID.
+	LAPIC_TPR         = 0x080 / 4,    //!< Task priority.
+	LAPIC_EOI         = 0x0B0 / 4,    //!< End of interrupt.
+	LAPIC_SVR         = 0x0F0 / 4,    //!< Spurious interrupt vector.
+	LAPIC_LVT_TIMER   = 0x320 / 4,    //!< Timer local vector table entry.
+	LAPIC_TIMER_INIT  = 0x380 / 4,    //!< Timer initial count.
+	LAPIC_TIMER_COUNT = 0x390 / 4,    //!< Timer current count.
+	LAPIC_TIMER_DIV   = 0x3E0 / 4     //!< Timer divide configuration.
+};
+
+#define LAPIC_SVR_ENABLE  0x100      //!< Software enable bit of the spurious vector register.
+#define LAPIC_LVT_MASKED  0x10000    //!< Local vector table entry masked.
+#define LAPIC_TIMER_DIV16 0x03       //!< Timer counts at the bus clock divided by 16.
+#define LAPIC_CALIBRATE   10000      //!< Microseconds to calibrate the timer over.
+
+//! I/O APIC registers, accessed through the select and window registers.
+enum {
+	IOAPIC_VERSION  = 0x01,    //!< Version and number of redirection entries.
+	IOAPIC_REDIR    = 0x10     //!< First redirection entry, two registers each.
+};
+
+#define IOAPIC_SELECT 0       //!< Register select, in 32bit words.
+#define IOAPIC_WINDOW 4       //!< Register data, in 32bit words.
+
+#define IOAPIC_REDIR_LOW    0x00002000    //!< Active low polarity.
+#define IOAPIC_REDIR_LEVEL  0x00008000    //!< Level triggered.
+#define IOAPIC_REDIR_MASKED 0x00010000    //!< Interrupt masked.
+
+#define OVERRIDE_POLARITY 0x03    //!< Override polarity bits.
+#define OVERRIDE_LOW      0x03    //!< Override polarity active low.
+#define OVERRIDE_TRIGGER  0x0C    //!< Override trigger mode bits.
+#define OVERRIDE_LEVEL    0x0C    //!< Override trigger mode level.
+
+#define MMIO_FLAGS (PAGING_FLAG_RW | PAGING_FLAG_WTHROUGH | PAGING_FLAG_CACHEDIS)    //!< Uncached device memory.
+
+/**
+ * An I/O APIC.
+ */
+typedef struct ioapic{
+	volatile uint32_t *regs;    //!< Mapped registers.
+	uint32_t gsi_base;          //!< First global system interrupt.
+	uint32_t gsi_count;         //!< Number of redirection entries.
+} ioapic;
+
+static volatile uint32_t *lapic = NULL;       //!< Mapped local APIC registers, NULL while the PICs are used.
+static ioapic ioapics[APIC_MAX_IOAPICS];      //!< I/O APICs found in the MADT.
+static uint32_t ioapic_count = 0;             //!< Number of I/O APICs.
+static uint32_t cpu_count = 0;                //!< Number of enabled processors.
+static uint32_t timer_freq = 0;               //!< Local APIC timer counts per second.
+static uint32_t isa_gsi[APIC_ISA_IRQS];       //!< Global system interrupt of each ISA IRQ.
+static uint32_t isa_flags[APIC_ISA_IRQS];     //!< Redirection polarity and trigger of each ISA IRQ.
+
+/**
+ * Reads an I/O APIC register.
+ * @param io The I/O APIC.
+ * @param reg The register number.
+ * @return The register value.
+ */
+static uint32_t ioapic_read(const ioapic *io, uint8_t reg){
+	io->regs[IOAPIC_SELECT] = reg;
+	return io->regs[IOAPIC_WINDOW];
+}
+
+/**
+ * Writes an I/O APIC register.
+ * @param io The I/O APIC.
+ * @param reg The register number.
+ * @param value The value to write.
+ */
+static void ioapic_write(const ioapic *io, uint8_t reg, uint32_t value){
+	io->regs[IOAPIC_SELECT] = reg;
+	io->regs[IOAPIC_WINDOW] = value;
+}
+
+/**
+ * Finds the I/O APIC handling a global system interrupt.
+ * @param gsi The global system interrupt.
+ * @return The I/O APIC, or NULL if none handles it.
+ */
+static const ioapic *ioapic_find(uint32_t gsi){
+	for(uint32_t i = 0; i < ioapic_count; ++i){
+		if(gsi >= ioapics[i].gsi_base && gsi - ioapics[i].gsi_base < ioapics[i].gsi_count){
+			return &ioapics[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Checks if an ISA IRQ lost its pin to an override.
+ * For example IRQ2 when IRQ0 is wired to GSI 2.
+ * @param irq The ISA IRQ number (0-15).
+ * @return true if another IRQ uses this IRQ's pin.
+ */
+static bool ioapic_shadowed(uint8_t irq){
+	if(isa_gsi[irq] != irq){
+		return false;
+	}
+	for(uint8_t other = 0; other < APIC_ISA_IRQS; ++other){
+		if(other != irq && isa_gsi[other] == irq){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Programs the redirection entry of an ISA IRQ.
+ * @param irq The ISA IRQ number (0-15).
+ * @param masked Leave the interrupt masked.
+ */
+static void ioapic_route(uint8_t irq, bool masked){
+	const ioapic *io = ioapic_find(isa_gsi[irq]);
+	if(io == NULL){
+		return;
+	}
+	uint8_t entry = IOAPIC_REDIR + (isa_gsi[irq] - io->gsi_base) * 2;
+	uint32_t dest = lapic[LAPIC_ID] >> 24;
+	uint32_t low = (IRQ0 + irq) | isa_flags[irq] | (masked ? IOAPIC_REDIR_MASKED : 0);
+	// Write the high half first so the entry is never live with a stale destination.
+	ioapic_write(io, entry, IOAPIC_REDIR_MASKED);
+	ioapic_write(io, entry + 1, dest << 24);
+	ioapic_write(io, entry, low);
+}
+
+/**
+ * Maps a page of device registers uncached.
+ * @param phys Physical address of the registers.
+ * @return Address of the mapped registers, or NULL on failure.
+ */
+static volatile uint32_t *apic_map(uint64_t phys){
+	void *virt = (void*)(uint32_t)(phys & ~0xFFFull);
+	if(paging_map(virt, phys & ~0xFFFull, 1, MMIO_FLAGS) != EOK){
+		return NULL;
+	}
+	return (volatile uint32_t*)(uint32_t)phys;
+}
+
+/**
+ * Reads the MADT, mapping every I/O APIC and recording ISA overrides.
+ * @param madt The MADT.
+ * @param lapic_addr Set to the physical address of the local APIC.
+ * @return Error code, or EOK if successful.
+ */
+static int apic_parse(const struct madt *madt, uint64_t *lapic_addr){
+	*lapic_addr = madt->lapic_addr;
+	for(int i = 0; i < APIC_ISA_IRQS; ++i){
+		isa_gsi[i] = i;
+		isa_flags[i] = 0;    // ISA default, active high and edge triggered.
+	}
+	
+	const uint8_t *pos = madt->entries;
+	const uint8_t *end = (const uint8_t*)madt + madt->header.length;
+	while(pos + sizeof(struct madt_entry) <= end){
+		const struct madt_entry *entry = (const struct madt_entry*)pos;
+		if(entry->length < sizeof(struct madt_entry) || pos + entry->length > end){
+			return EFAULT;
+		}
+		switch((enum madt_type)entry->type){
+			case MADT_LAPIC:{
+				const struct madt_lapic *cpu = (const struct madt_lapic*)entry;
+				if(cpu->flags & 0x01){
+					++cpu_count;
+				}
+				break;
+			}
+			case MADT_IOAPIC:{
+				const struct madt_ioapic *io = (const struct madt_ioapic*)entry;
+				if(ioapic_count < APIC_MAX_IOAPICS){
+					ioapic *dev = &ioapics[ioapic_count];
+					dev->regs = apic_map(io->addr);
+					if(dev->regs != NULL){
+						dev->gsi_base = io->gsi_base;
+						dev->gsi_count = ((ioapic_read(dev, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+						++ioapic_count;
+					}
+				}
+				break;
+			}
+			case MADT_OVERRIDE:{
+				const struct madt_override *over = (const struct madt_override*)entry;
+				if(over->bus == 0 && over->source < APIC_ISA_IRQS){
+					isa_gsi[over->source] = over->gsi;
+					uint32_t flags = 0;
+					if((over->flags & OVERRIDE_POLARITY) == OVERRIDE_LOW){
+						flags |= IOAPIC_REDIR_LOW;
+					}
+					if((over->flags & OVERRIDE_TRIGGER) == OVERRIDE_LEVEL){
+						flags |= IOAPIC_REDIR_LEVEL;
+					}
+					isa_flags[over->source] = flags;
+				}
+				break;
+			}
+			case MADT_LAPIC_OVERRIDE:
+				*lapic_addr = ((const struct madt_lapic_override*)entry)->addr;
+				break;
+			case MADT_NMI_SOURCE:
+			case MADT_LAPIC_NMI:
+			default:
+				break;
+		}
+		pos += entry->length;
+	}
+	return ioapic_count ? EOK : ENODEV;
+}
+
+/**
+ * Switches interrupt delivery from the 8259 PICs to the APICs.
+ * The controllers are found through the ACPI MADT, so this must be called
+ * after acpi_init() and paging_init().  The PICs are left in use if
+ * anything is missing.
+ * @return Error code, or EOK if successful.
+ */
+int apic_init(){
+	if(lapic != NULL){
+		return EALREADY;
+	}
+	if(!(cpuid(0x00000001).edx & (1 << 9))){
+		return ENODEV;
+	}
+	const struct madt *madt = (const struct madt*)sdt_desc.bread((unsigned int)madt_sig);
+	if(madt == NULL){
+		return ENODEV;
+	}
+	
+	uint64_t lapic_addr;
+	cpu_count = 0;
+	ioapic_count = 0;
+	int ret = apic_parse(madt, &lapic_addr);
+	if(ret != EOK){
+		return ret;
+	}
+	
+	// The PICs turned the local APIC off, some older CPUs cannot turn it back on.
+	uint32_t msrhi, msrlo;
+	rdmsr(APIC_BASE_MSR, &msrhi, &msrlo);
+	wrmsr(APIC_BASE_MSR, msrhi, (msrlo & ~APIC_BASE_MASK) | ((uint32_t)lapic_addr & APIC_BASE_MASK) | APIC_ENABLE);
+	rdmsr(APIC_BASE_MSR, &msrhi, &msrlo);
+	if(!(msrlo & APIC_ENABLE)){
+		return ENODEV;
+	}
+	volatile uint32_t *regs = apic_map(lapic_addr);
+	if(regs == NULL){
+		return ENOMEM;
+	}
+	
+	uint32_t flags = int_save();
+	// Mask both PICs, anything they already raised is discarded.
+	outb(PIC_MASTER_DATA, 0xFF);
+	outb(PIC_SLAVE_DATA, 0xFF);
+	
+	lapic = regs;
+	lapic[LAPIC_TPR] = 0;
+	lapic[LAPIC_SVR] = LAPIC_SVR_ENABLE | ISR_SPURIOUS;
+	
+	for(uint8_t irq = 0; irq < APIC_ISA_IRQS; ++irq){
+		if(!ioapic_shadowed(irq)){
+			ioapic_route(irq, !isr_registered(IRQ0 + irq));
+		}
+	}
+	int_restore(flags);
+	return EOK;
+}
+
+/**
+ * Checks if interrupts are delivered through the APICs.
+ * @return true if the APICs are in use, false if the PICs are.
+ */
+bool apic_enabled(){
+	return lapic != NULL;
+}
+
+/**
+ * Signals the end of an interrupt to the local APIC.
+ * @return true if the EOI was sent, false if the PICs are in use.
+ */
+bool apic_eoi(){
+	if(lapic == NULL){
+		return false;
+	}
+	lapic[LAPIC_EOI] = 0;
+	return true;
+}
+
+/**
+ * Unmasks an ISA IRQ at the I/O APIC.
+ * Does nothing while the PICs are in use.
+ * @param irq The ISA IRQ number (0-15).
+ */
+void apic_irq_unmask(uint8_t irq){
+	if(lapic == NULL || irq >= APIC_ISA_IRQS || ioapic_shadowed(irq)){
+		return;
+	}
+	uint32_t flags = int_save();
+	ioapic_route(irq, false);
+	int_restore(flags);
+}
+
+/**
+ * Gets the number of enabled processors listed in the MADT.
+ * @return Number of processors, 0 before apic_init().
+ */
+uint32_t apic_cpu_count(){
+	return cpu_count;
+}
+
+/**
+ * Calibrates the local APIC timer against the PIT and leaves it stopped.
+ * The timer raises ISR_APIC_TIMER when it expires.
+ * @return Timer counts per second, or 0 if the APICs are not in use.
+ */
+uint32_t apic_timer_init(){
+	if(lapic == NULL){
+		return 0;
+	}
+	uint32_t flags = int_save();
+	lapic[LAPIC_TIMER_DIV] = LAPIC_TIMER_DIV16;
+	lapic[LAPIC_LVT_TIMER] = LAPIC_LVT_MASKED | ISR_APIC_TIMER;
+	lapic[LAPIC_TIMER_INIT] = 0xFFFFFFFF;
+	pit_delay(LAPIC_CALIBRATE);
+	uint32_t elapsed = 0xFFFFFFFF - lapic[LAPIC_TIMER_COUNT];
+	lapic[LAPIC_TIMER_INIT] = 0;
+	lapic[LAPIC_LVT_TIMER] = ISR_APIC_TIMER;    // One-shot mode.
+	int_restore(flags);
+	
+	timer_freq = elapsed * (1000000 / LAPIC_CALIBRATE);
+	return timer_freq;
+}
+
+/**
+ * Starts the local APIC timer counting down once.
+ * Any count already running is replaced.
+ * @param count Timer counts until the interrupt, 0 stops the timer.
+ */
+void apic_timer_oneshot(uint32_t count){
+	if(lapic != NULL){
+		lapic[LAPIC_TIMER_INIT] = count;
+	}
+}
+
+/**
+ * Gets the counts left before the local APIC timer expires.
+ * @return Remaining counts, 0 once expired or stopped.
+ */
+uint32_t apic_timer_remaining(){
+	return lapic ? lapic[LAPIC_TIMER_COUNT] : 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file interrupt/apic.h
+ * Local APIC and I/O APIC interrupt controllers.
+ * @author Conlan Wesson
+ */
+
+#ifndef __INTERRUPT_APIC_H_
+#define __INTERRUPT_APIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Switches interrupt delivery from the 8259 PICs to the APICs.
+ * The controllers are found through the ACPI MADT, so this must be called
+ * after acpi_init() and paging_init().  The PICs are left in use if
+ * anything is missing.
+ * @return Error code, or EOK if successful.
+ */
+int apic_init();
+
+/**
+ * Checks if interrupts are delivered through the APICs.
+ * @return true if the APICs are in use, false if the PICs are.
+ */
+bool apic_enabled();
+
+/**
+ * Signals the end of an interrupt to the local APIC.
+ * @return true if the EOI was sent, false if the PICs are in use.
+ */
+bool apic_eoi();
+
+/**
+ * Unmasks an ISA IRQ at the I/O APIC.
+ * Does nothing while the PICs are in use.
+ * @param irq The ISA IRQ number (0-15).
+ */
+void apic_irq_unmask(uint8_t irq);
+
+/**
+ * Gets the number of enabled processors listed in the MADT.
+ * @return Number of processors, 0 before apic_init().
+ */
+uint32_t apic_cpu_count();
+
+/**
+ * Calibrates the local APIC timer against the PIT and leaves it stopped.
+ * The timer raises ISR_APIC_TIMER when it expires.
+ * @return Timer counts per second, or 0 if the APICs are not in use.
+ */
+uint32_t apic_timer_init();
+
+/**
+ * Starts the local APIC timer counting down once.
+ * Any count already running is replaced.
+ * @param count Timer counts until the interrupt, 0 stops the timer.
+ */
+void apic_timer_oneshot(uint32_t count);
+
+/**
+ * Gets the counts left before the local APIC timer expires.
+ * @return Remaining counts, 0 once expired or stopped.
+ */
+uint32_t apic_timer_remaining();
+
+#endif
@@ -172,6 +172,8 @@ extern void isr29();
 extern void isr30();
 extern void isr31();
 extern void isr128();  // System call interrupt
+extern void irq_apic_timer();  // Local APIC timer
+extern void isr_spurious();  // Spurious local APIC interrupt
 
 extern void irq0();
 extern void irq1();
@@ -348,7 +350,7 @@ static void idt_set_gate(uint8_t num, void (*handler)(), idt_priv rpl, uint16_t
  * Initializes the IDT.
  */
 static void idt_init(){
-	// Put the APIC into legacy mode.
+	// Put the APIC into legacy mode, apic_init() enables it again.
 	uint32_t msrhi, msrlo;
 	rdmsr(APIC_BASE_MSR, &msrhi, &msrlo);
 	wrmsr(APIC_BASE_MSR, msrhi, msrlo & ~APIC_ENABLE);
@@ -366,7 +368,8 @@ static void idt_init(){
 	outb(PIC_SLAVE_DATA, 0x02);
 	outb(PIC_MASTER_DATA, PIC_8086_MODE);
 	outb(PIC_SLAVE_DATA, PIC_8086_MODE);
-	outb(PIC_MASTER_DATA, master);
+	// Keep the timer masked until clock_init() registers a handler for it.
+	outb(PIC_MASTER_DATA, master | (1 << (IRQ0 - PIC_MASTER_IRQ_OFFSET)));
 	outb(PIC_SLAVE_DATA, slave);
 	
 	uint8_t sel = IDT_PRIV0;
@@ -424,6 +427,9 @@ static void idt_init(){
 	idt_set_gate(IRQ15, irq15, sel, index, IDT_INT32, IDT_PRIV0);
 	// Register system call interrupt
 	idt_set_gate(ISR_SYSCALL, isr128, sel, index, IDT_INT32, IDT_PRIV0);
+	idt_set_gate(ISR_APIC_TIMER, irq_apic_timer, sel, index, IDT_INT32, IDT_PRIV0);
+	// Spurious local APIC interrupts are dropped without an EOI.
+	idt_set_gate(ISR_SPURIOUS, isr_spurious, sel, index, IDT_INT32, IDT_PRIV0);
 
 	idt_flush(&idtp);
 }
@@ -10,7 +10,9 @@
 #include <kernel/panic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "apic.h"
 #include "dev/ram.h"
+#include "sys/thread.h"
 
 #define PIC_EOI 0x20    //!< End-of-Interrupt command
 
@@ -76,11 +78,28 @@ void irq_handler(isr_regs regs){
 		printf("Unhandled IRQ:  %u\n", regs.int_no);
 	}
 
-	// Send EOI signal to the PICs.
-	if(regs.int_no >= PIC_SLAVE_IRQ_START){
-		outb(PIC_SLAVE_CMD, PIC_EOI);
+	// Send EOI signal to the local APIC, or to the PICs.
+	if(!apic_eoi()){
+		if(regs.int_no >= PIC_SLAVE_IRQ_START){
+			outb(PIC_SLAVE_CMD, PIC_EOI);
+		}
+		outb(PIC_MASTER_CMD, PIC_EOI);
+	}
+	
+	// Switch threads now the interrupt is acknowledged, this one resumes here.
+	thread_preempt();
+}
+
+/**
+ * Unmasks an IRQ at the 8259 PICs.
+ * @param n The interrupt number (IRQ0-IRQ15).
+ */
+static void pic_irq_unmask(uint8_t n){
+	if(n >= PIC_SLAVE_IRQ_START){
+		outb(PIC_SLAVE_DATA, inb(PIC_SLAVE_DATA) & ~(1 << (n - PIC_SLAVE_IRQ_START)));
+	}else{
+		outb(PIC_MASTER_DATA, inb(PIC_MASTER_DATA) & ~(1 << (n - IRQ0)));
 	}
-	outb(PIC_MASTER_CMD, PIC_EOI);
 }
 
 /**
@@ -90,5 +109,21 @@ void irq_handler(isr_regs regs){
  */
 void isr_register(uint8_t n, isr handler){
 	interrupt_handlers[n] = handler;
+	if(handler != 0 && n >= IRQ0 && n <= IRQ15){
+		if(apic_enabled()){
+			apic_irq_unmask(n - IRQ0);
+		}else{
+			pic_irq_unmask(n);
+		}
+	}
+}
+
+/**
+ * Checks if an interrupt has a handler.
+ * @param n The interrupt number.
+ * @return true if a handler is registered.
+ */
+bool isr_registered(uint8_t n){
+	return interrupt_handlers[n] != 0;
 }
 
@@ -7,6 +7,7 @@
 #ifndef __INTERRUPT_ISR_H_
 #define __INTERRUPT_ISR_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // Master PIC IRQs
@@ -28,6 +29,8 @@
 #define IRQ14 46  //!< Primary ATA
 #define IRQ15 47  //!< Secondary ATA
 #define ISR_SYSCALL 0x80  //!< System Call
+#define ISR_APIC_TIMER 0xF0 //!< Local APIC timer
+#define ISR_SPURIOUS 0xFF //!< Spurious local APIC interrupt
 
 #define PIC_SLAVE_IRQ_START IRQ8  //!< First IRQ on the slave PIC
 
@@ -59,5 +62,12 @@ typedef void (*isr)(isr_regs);
  */
 void isr_register(uint8_t, isr);
 
+/**
+ * Checks if an interrupt has a handler.
+ * @param n The interrupt number.
+ * @return true if a handler is registered.
+ */
+bool isr_registered(uint8_t);
+
 #endif
 
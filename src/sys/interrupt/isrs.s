@@ -104,6 +104,24 @@ ISR_NOERRCODE 30
 ISR_NOERRCODE 31
 ISR_NOERRCODE 128
 
+;;
+; Local APIC timer, handled like an IRQ.
+; The vector does not fit a signed byte, so it is pushed as a dword.
+;;
+[GLOBAL irq_apic_timer]
+irq_apic_timer:
+	cli
+	push  byte 0
+	push  dword 0xF0
+	jmp   irq_common_stub
+
+;;
+; Handler for spurious local APIC interrupts, which must not be acknowledged.
+;;
+[GLOBAL isr_spurious]
+isr_spurious:
+	iret
+
 IRQ 0,  32
 IRQ 1,  33
 IRQ 2,  34
@@ -126,6 +144,7 @@ IRQ 15, 47
 ;;
 isr_common_stub:
 	pusha             ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax.
+	cld               ; The C handlers expect string instructions to count up.
 	
 	mov   ax, ds      ; Lower 16-bits of eax = ds.
 	push  eax         ; Save the data segment descriptor.
@@ -154,6 +173,7 @@ isr_common_stub:
 ;;
 irq_common_stub:
 	pusha             ; Pushes edi,esi,ebp,esp,ebx,edx,ecx,eax.
+	cld               ; The C handlers expect string instructions to count up.
 	
 	mov   ax, ds      ; Lower 16-bits of eax = ds.
 	push  eax         ; Save the data segment descriptor.
@@ -6,30 +6,336 @@
 
 #include "paging.h"
 
+#include <errno.h>
+#include <kernel/cpuid.h>
+#include <kernel/int.h>
 #include <kernel/panic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include "dev/ram.h"
+#include "sys/clock.h"
+#include "sys/frame.h"
 #include "sys/interrupt/isr.h"
 
 enum {
-	PAGING_FLAG_PRESENT  = 0x0001,
-	PAGING_FLAG_RW       = 0x0002,
-	PAGING_FLAG_USER     = 0x0004,
-	PAGING_FLAG_WTHROUGH = 0x0008,
-	PAGING_FLAG_CACHEDIS = 0x0010,
-	PAGING_FLAG_ACCESSED = 0x0020,
-	PAGING_FLAG_DIRTY    = 0x0040,
-	PAGING_FLAG_PGESIZE  = 0x0080,
-	PAGING_FLAG_GLOBAL   = 0x0100
+	PAGING_ENTRIES   = 512,           //!< Number of entries in a PDT or PT.
+	PAGING_PDPT_SIZE = 4,             //!< Number of entries in the PDPT.
+	PAGING_PAGE      = 0x1000,        //!< Size of a page.
+	PAGING_LARGE     = 0x00200000,    //!< Size of a large page.
+	PAGING_LOW_LIMIT = 0x00200000,    //!< Memory mapped by the first page table.
+	PAGING_RESERVE   = 4,             //!< Page tables available before the frame allocator.
+	PAGING_FLUSH_MAX = 32             //!< Most pages invalidated one at a time before flushing everything.
 };
 
-static uint64_t *pdpt    = (uint64_t*)0x1000;    //!< Pointer to the first Page Directory Pointer Table.
-static uint64_t *pdt     = (uint64_t*)0x2000;    //!< Pointer to the first Page Directory Table.
-static uint64_t *pt      = (uint64_t*)0x3000;    //!< Pointer to the first Page Table.
-static uint64_t *pdttemp = (uint64_t*)0x4000;
-static uint64_t *pttemp  = (uint64_t*)0x5000;
+#define PAGING_ADDR_MASK  0x00000000FFFFF000ull    //!< Physical address bits of an entry.
+#define PAGING_ADDR_LIMIT 0x0000000100000000ull    //!< Memory above this can not be identity mapped.
+#define PAGING_LARGE_MASK 0x00000000FFE00000ull    //!< Physical address bits of a large page entry.
+//! Flags for kernel mappings.
+#define PAGING_KERNEL (PAGING_FLAG_PRESENT | PAGING_FLAG_RW | PAGING_FLAG_GLOBAL)
 
+//! Page Directory Pointer Table.
+static uint64_t pdpt[PAGING_PDPT_SIZE] __attribute__((aligned(32)));
+//! Page Directory Tables, one for each PDPT entry.
+static uint64_t pdt[PAGING_PDPT_SIZE][PAGING_ENTRIES] __attribute__((aligned(PAGING_PAGE)));
+//! Page Table for the first 2MiB.
+static uint64_t pt[PAGING_ENTRIES] __attribute__((aligned(PAGING_PAGE)));
+//! Page tables used until the frame allocator is running.
+static uint64_t pool_reserve[PAGING_RESERVE][PAGING_ENTRIES] __attribute__((aligned(PAGING_PAGE)));
+//! Stack of unused tables from pool_reserve.
+static uint32_t pool_free[PAGING_RESERVE];
+//! Number of unused tables in pool_free.
+static uint32_t pool_free_count = 0;
+//! Virtual page used to reach page tables outside the first 2MiB.
+static uint8_t window[PAGING_PAGE] __attribute__((aligned(PAGING_PAGE)));
 
+static uint32_t fault_count = 0;     //!< Number of not-present faults handled.
+static uint32_t fault_window = 0;    //!< Faults since fault_mark.
+static uint32_t fault_rate = 0;      //!< Faults during the last full second.
+static uint64_t fault_mark = 0;      //!< Monotonic time at the start of the current second.
+static uint32_t table_count = 0;     //!< Number of page tables allocated.
+static uint32_t large_count = 0;     //!< Number of large pages mapped.
+static bool paging_global = false;   //!< Global pages are enabled.
+
+/**
+ * Invalidates the TLB entry for a page.
+ * @param addr Virtual address in the page.
+ */
+static inline void paging_invlpg(const void *addr){
+	asm volatile(
+		"invlpg (%0)"
+		:: "r"(addr)
+		: "memory"
+	);
+}
+
+/**
+ * Invalidates all TLB entries, including global ones.
+ */
+static inline void paging_flush_all(){
+	if(paging_global){
+		// Toggling CR4.PGE drops global entries as well.
+		asm volatile(
+			"movl %%cr4, %%eax;"
+			"btr $7, %%eax;"
+			"movl %%eax, %%cr4;"
+			"bts $7, %%eax;"
+			"movl %%eax, %%cr4"
+			::: "eax", "memory"
+		);
+	}else{
+		asm volatile(
+			"movl %%cr3, %%eax;"
+			"movl %%eax, %%cr3"
+			::: "eax", "memory"
+		);
+	}
+}
+
+/**
+ * Invalidates the TLB entries for a range of pages.
+ * Large ranges flush the whole TLB instead of invalidating each page.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ */
+static void paging_invalidate(uint32_t virt, uint32_t count){
+	if(count > PAGING_FLUSH_MAX){
+		paging_flush_all();
+		return;
+	}
+	for(uint32_t i = 0; i < count; ++i){
+		paging_invlpg((void*)(virt + i*PAGING_PAGE));
+	}
+}
+
+/**
+ * Gets the page directory entry for a virtual address.
+ * @param virt The virtual address.
+ * @return Pointer to the directory entry.
+ */
+static inline uint64_t *paging_dir(uint32_t virt){
+	return &pdt[virt >> 30][(virt >> 21) & (PAGING_ENTRIES - 1)];
+}
+
+/**
+ * Gets a usable pointer to a page table.
+ * Tables above the first 2MiB are reached through the window page, so the
+ * pointer is only valid until the next call.
+ * @param phys Physical address of the table.
+ * @return Pointer to the table.
+ */
+static uint64_t *paging_table(uint32_t phys){
+	if(phys < PAGING_LOW_LIMIT){
+		return (uint64_t*)phys;
+	}
+	uint32_t index = ((uint32_t)window >> 12) & (PAGING_ENTRIES - 1);
+	pt[index] = (uint64_t)phys | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
+	paging_invlpg(window);
+	return (uint64_t*)window;
+}
+
+/**
+ * Allocates and clears a page table from the pool.
+ * @return Physical address of the table, or 0 if out of memory.
+ */
+static uint32_t paging_pool_alloc(){
+	uint32_t phys;
+	if(pool_free_count){
+		phys = pool_free[--pool_free_count];
+	}else{
+		phys = (uint32_t)frame_alloc();
+		if(!phys){
+			return 0;
+		}
+	}
+	memset(paging_table(phys), 0, PAGING_PAGE);
+	++table_count;
+	return phys;
+}
+
+/**
+ * Returns a page table to the pool.
+ * @param phys Physical address of the table.
+ */
+static void paging_pool_free(uint32_t phys){
+	if(phys < PAGING_LOW_LIMIT){
+		pool_free[pool_free_count++] = phys;
+	}else{
+		frame_free((void*)phys);
+	}
+	--table_count;
+}
+
+/**
+ * Sets the page table entry for a virtual address.
+ * Allocates the page table if the PDT slot is empty.
+ * @param virt The virtual address.
+ * @param entry The new page table entry.
+ * @return Error code, or EOK if successful.
+ */
+static int paging_set(uint32_t virt, uint64_t entry){
+	uint64_t *dir = paging_dir(virt);
+	if(*dir & PAGING_FLAG_PGESIZE){
+		return EEXIST;
+	}
+	if(!(*dir & PAGING_FLAG_PRESENT)){
+		uint32_t table = paging_pool_alloc();
+		if(!table){
+			return ENOMEM;
+		}
+		*dir = (uint64_t)table | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
+	}
+	uint64_t *table = paging_table((uint32_t)(*dir & PAGING_ADDR_MASK));
+	table[(virt >> 12) & (PAGING_ENTRIES - 1)] = entry;
+	return EOK;
+}
+
+/**
+ * Maps a 2MiB block of physical memory to itself with a large page.
+ * A page table already covering the block is only replaced if all of its
+ * pages are plain identity mappings.
+ * @param block The 2MiB aligned address.
+ * @return true if the block is mapped by a large page.
+ */
+static bool paging_set_large(uint32_t block){
+	uint64_t *dir = paging_dir(block);
+	const uint64_t flags = PAGING_KERNEL;
+	if(*dir & PAGING_FLAG_PGESIZE){
+		return true;
+	}
+	if(*dir & PAGING_FLAG_PRESENT){
+		uint32_t phys = (uint32_t)(*dir & PAGING_ADDR_MASK);
+		uint64_t *table = paging_table(phys);
+		for(uint32_t i = 0; i < PAGING_ENTRIES; ++i){
+			uint64_t expect = (uint64_t)(block + i*PAGING_PAGE) | flags;
+			uint64_t entry = table[i] & ~(uint64_t)(PAGING_FLAG_ACCESSED | PAGING_FLAG_DIRTY);
+			if(table[i] && entry != expect){
+				return false;
+			}
+		}
+		paging_pool_free(phys);
+	}
+	*dir = (uint64_t)block | flags | PAGING_FLAG_PGESIZE;
+	++large_count;
+	return true;
+}
+
+/**
+ * Identity maps a range of memory, using large pages for whole 2MiB blocks.
+ * @param start Start of the range.
+ * @param end End of the range.
+ * @return Error code, or EOK if successful.
+ */
+static int paging_identity(uint64_t start, uint64_t end){
+	start &= ~(uint64_t)(PAGING_PAGE - 1);
+	while(start < end){
+		if(!(start & (PAGING_LARGE - 1)) && start + PAGING_LARGE <= end && paging_set_large(start)){
+			start += PAGING_LARGE;
+		}else{
+			int ret = paging_set(start, start | PAGING_KERNEL);
+			if(ret != EOK && ret != EEXIST){
+				return ret;
+			}
+			start += PAGING_PAGE;
+		}
+	}
+	return EOK;
+}
+
+/**
+ * Replaces a large page with a page table mapping the same memory.
+ * @param dir The directory entry of the large page.
+ * @return Error code, or EOK if successful.
+ */
+static int paging_split(uint64_t *dir){
+	uint32_t phys = paging_pool_alloc();
+	if(!phys){
+		return ENOMEM;
+	}
+	uint64_t base = *dir & PAGING_LARGE_MASK;
+	uint64_t flags = *dir & (PAGING_PAGE - 1) & ~(uint64_t)PAGING_FLAG_PGESIZE;
+	uint64_t *table = paging_table(phys);
+	for(uint32_t i = 0; i < PAGING_ENTRIES; ++i){
+		table[i] = (base + i*PAGING_PAGE) | flags;
+	}
+	*dir = (uint64_t)phys | PAGING_FLAG_PRESENT | PAGING_FLAG_RW | (*dir & PAGING_FLAG_USER);
+	--large_count;
+	return EOK;
+}
+
+/**
+ * Finds the page table entry for a virtual address.
+ * A large page covering the address is split into a page table first.
+ * @param virt The virtual address.
+ * @param create true to allocate a missing page table.
+ * @return Pointer to the entry, valid until the next page table access, or
+ *         NULL if there is no page table.
+ */
+static uint64_t *paging_entry(uint32_t virt, bool create){
+	uint64_t *dir = paging_dir(virt);
+	if(*dir & PAGING_FLAG_PGESIZE){
+		if(paging_split(dir) != EOK){
+			return NULL;
+		}
+	}else if(!(*dir & PAGING_FLAG_PRESENT)){
+		if(!create){
+			return NULL;
+		}
+		uint32_t table = paging_pool_alloc();
+		if(!table){
+			return NULL;
+		}
+		*dir = (uint64_t)table | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
+	}
+	uint64_t *table = paging_table((uint32_t)(*dir & PAGING_ADDR_MASK));
+	return &table[(virt >> 12) & (PAGING_ENTRIES - 1)];
+}
+
+/**
+ * Builds a page table entry's flags from the caller's flags.
+ * Everything that is not a user page is global.
+ * @param flags Any of PAGING_FLAG_RW, USER, WTHROUGH and CACHEDIS.
+ * @return Flags for the page table entry.
+ */
+static inline uint64_t paging_flags(uint32_t flags){
+	flags &= PAGING_FLAG_RW | PAGING_FLAG_USER | PAGING_FLAG_WTHROUGH | PAGING_FLAG_CACHEDIS;
+	flags |= PAGING_FLAG_PRESENT;
+	if(!(flags & PAGING_FLAG_USER)){
+		flags |= PAGING_FLAG_GLOBAL;
+	}
+	return flags;
+}
+
+/**
+ * Checks that a range of pages fits in the address space.
+ * @param addr Address of the first page.
+ * @param count Number of pages.
+ * @return true if the range is page aligned and below 4GiB.
+ */
+static inline bool paging_range(uint64_t addr, uint32_t count){
+	return !(addr & (PAGING_PAGE - 1)) && addr + ((uint64_t)count << 12) <= PAGING_ADDR_LIMIT;
+}
+
+/**
+ * Counts a page fault towards the fault rate.
+ */
+static void paging_count_fault(){
+	++fault_count;
+	++fault_window;
+	uint64_t now = clock_ns();
+	if(clock_running() && now - fault_mark >= CLOCK_NS_PER_SEC){
+		// Only a window of about one second is a useful rate.
+		fault_rate = (now - fault_mark < 2 * CLOCK_NS_PER_SEC) ? fault_window : 0;
+		fault_window = 0;
+		fault_mark = now;
+	}
+}
+
+/**
+ * Page fault handler, maps not-present pages on demand.
+ * @param regs Registers from before the interrupt.
+ */
 static void paging_isr(isr_regs regs){
 	uint32_t addr;
 	asm volatile(
@@ -42,6 +348,21 @@ static void paging_isr(isr_regs regs){
 	int user = regs.err_code & PAGING_FLAG_USER;            // Processor was in user-mode?
 	int reserved = regs.err_code & PAGING_FLAG_WTHROUGH;    // Overwritten CPU-reserved bits of page entry?
 	
+	bool guard = false;
+	if(!present){
+		paging_count_fault();
+		uint32_t page = addr & ~(PAGING_PAGE - 1);
+		uint64_t *dir = paging_dir(page);
+		if((*dir & PAGING_FLAG_PRESENT) && !(*dir & PAGING_FLAG_PGESIZE)){
+			uint64_t *entry = paging_entry(page, false);
+			guard = entry && (*entry & PAGING_FLAG_GUARD);
+		}
+		// Identity map the faulting page.
+		if(!guard && paging_set(page, (uint64_t)page | PAGING_KERNEL) == EOK){
+			return;
+		}
+	}
+	
 	printf("\e[1;33mPage Fault @ 0x%X ", addr);
 	if(!present){
 		puts("not-present ");
@@ -55,47 +376,207 @@ static void paging_isr(isr_regs regs){
 	if(reserved){
 		puts("reserved ");
 	}
+	if(guard){
+		puts("guard ");
+	}
 	puts("\e[0m\n");
-	
-	if(!present){
-		uint32_t pdptindex = (addr & 0xC0000000) >> 30;
-		uint32_t pdtindex  = (addr & 0x3FE00000) >> 21;
-		uint32_t ptindex   = (addr & 0x001FF000) >> 12;
-		uint32_t address   = (addr & 0xFFFFF000);
-		
-		if(pdptindex == 0){
-			pdt[pdtindex] = (uint64_t)(uint32_t)&pttemp[0] | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
-			pttemp[ptindex] = (uint64_t)address | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
-		}else{
-			pdpt[pdptindex] = (uint64_t)(uint32_t)&pdttemp[0] | PAGING_FLAG_PRESENT;
-			pdttemp[pdtindex] = (uint64_t)(uint32_t)&pttemp[0] | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
-			pttemp[ptindex] = (uint64_t)address | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
+	panic("Page Fault");
+}
+
+/**
+ * Gets the paging statistics.
+ * @param stats Structure to fill.
+ */
+void paging_get_stats(paging_stats *stats){
+	stats->faults = fault_count;
+	stats->fault_rate = fault_rate;
+	if(clock_running() && clock_ns() - fault_mark >= 2 * CLOCK_NS_PER_SEC){
+		// No faults for a while.
+		stats->fault_rate = 0;
+	}
+	stats->tables = table_count;
+	stats->large = large_count;
+}
+
+/**
+ * Identity maps all usable RAM above the first 2MiB.
+ * Whole 2MiB blocks inside a usable range are mapped with large pages, so
+ * only the edges of each range and the first 2MiB use page tables.
+ * @return Error code, or EOK if successful.
+ */
+int paging_map_ram(){
+	struct mmap_entry *mmap = ram_mmap();
+	const uint32_t end_map = (uint32_t)mmap + ram_mmap_length();
+	uint32_t save = int_save();
+	int ret = EOK;
+	for(; (uint32_t)mmap < end_map && ret == EOK; mmap = (struct mmap_entry*)((uint32_t)mmap + mmap->size + sizeof(uint32_t))){
+		uint64_t start = mmap->addr;
+		uint64_t end = mmap->addr + mmap->len;
+		if(mmap->type != RAM_BLOCK_USABLE || end <= PAGING_LOW_LIMIT || start >= PAGING_ADDR_LIMIT){
+			continue;
 		}
-	}else{
-		panic("Page Fault");
+		if(start < PAGING_LOW_LIMIT){
+			start = PAGING_LOW_LIMIT;
+		}
+		if(end > PAGING_ADDR_LIMIT){
+			end = PAGING_ADDR_LIMIT;
+		}
+		ret = paging_identity(start, end);
+	}
+	paging_flush_all();
+	int_restore(save);
+	return ret;
+}
+
+/**
+ * Maps a range of pages, replacing any existing mappings.
+ * Large pages in the way are split into page tables.
+ * @param virt Virtual address of the first page.
+ * @param phys Physical address of the first page.
+ * @param count Number of pages.
+ * @param flags Any of PAGING_FLAG_RW, USER, WTHROUGH and CACHEDIS.
+ * @return Error code, or EOK if successful.
+ */
+int paging_map(void *virt, uint64_t phys, uint32_t count, uint32_t flags){
+	uint32_t addr = (uint32_t)virt;
+	if(!paging_range(addr, count) || !paging_range(phys, count)){
+		return EINVAL;
 	}
+	uint32_t save = int_save();
+	int ret = EOK;
+	uint32_t i;
+	for(i = 0; i < count; ++i){
+		uint64_t *entry = paging_entry(addr + i*PAGING_PAGE, true);
+		if(!entry){
+			ret = ENOMEM;
+			break;
+		}
+		*entry = (phys + i*PAGING_PAGE) | paging_flags(flags);
+	}
+	paging_invalidate(addr, i);
+	int_restore(save);
+	return ret;
+}
+
+/**
+ * Unmaps a range of pages.
+ * A later access faults and is identity mapped like any other unmapped page.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @return Error code, or EOK if successful.
+ */
+int paging_unmap(void *virt, uint32_t count){
+	uint32_t addr = (uint32_t)virt;
+	if(!paging_range(addr, count)){
+		return EINVAL;
+	}
+	uint32_t save = int_save();
+	int ret = EOK;
+	for(uint32_t i = 0; i < count; ++i){
+		uint32_t page = addr + i*PAGING_PAGE;
+		uint64_t *dir = paging_dir(page);
+		if(!(*dir & PAGING_FLAG_PRESENT)){
+			continue;
+		}
+		uint64_t *entry = paging_entry(page, false);
+		if(!entry){
+			ret = ENOMEM;
+			break;
+		}
+		*entry = 0;
+	}
+	paging_invalidate(addr, count);
+	int_restore(save);
+	return ret;
+}
+
+/**
+ * Turns a range of pages into guard pages.
+ * Any access to a guard page panics instead of being mapped on demand.
+ * paging_map() makes them usable again.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @return Error code, or EOK if successful.
+ */
+int paging_guard(void *virt, uint32_t count){
+	uint32_t addr = (uint32_t)virt;
+	if(!paging_range(addr, count)){
+		return EINVAL;
+	}
+	uint32_t save = int_save();
+	int ret = EOK;
+	for(uint32_t i = 0; i < count; ++i){
+		uint64_t *entry = paging_entry(addr + i*PAGING_PAGE, true);
+		if(!entry){
+			ret = ENOMEM;
+			break;
+		}
+		*entry = PAGING_FLAG_GUARD;
+	}
+	paging_invalidate(addr, count);
+	int_restore(save);
+	return ret;
+}
+
+/**
+ * Changes the flags of a range of mapped pages.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @param flags Any of PAGING_FLAG_RW, USER, WTHROUGH and CACHEDIS.
+ * @return Error code, or EOK if successful.
+ */
+int paging_protect(void *virt, uint32_t count, uint32_t flags){
+	uint32_t addr = (uint32_t)virt;
+	if(!paging_range(addr, count)){
+		return EINVAL;
+	}
+	uint32_t save = int_save();
+	int ret = EOK;
+	uint32_t i;
+	for(i = 0; i < count; ++i){
+		uint32_t page = addr + i*PAGING_PAGE;
+		if(!(*paging_dir(page) & PAGING_FLAG_PRESENT)){
+			ret = EFAULT;
+			break;
+		}
+		uint64_t *entry = paging_entry(page, false);
+		if(!entry){
+			ret = ENOMEM;
+			break;
+		}
+		if(!(*entry & PAGING_FLAG_PRESENT)){
+			ret = EFAULT;
+			break;
+		}
+		*entry = (*entry & PAGING_ADDR_MASK) | paging_flags(flags);
+	}
+	paging_invalidate(addr, i);
+	int_restore(save);
+	return ret;
 }
 
 /**
  * Initializing paging directory and tables.
  */
 void paging_init(){
-	for(int i = 0; i < 512; ++i){
-		pdpt[i] = 0;
-		pdt[i] = 0;
-		pdttemp[i] = 0;
-		pttemp[i] = 0;
+	if((uint32_t)window >= PAGING_LOW_LIMIT){
+		panic("Paging window outside of the first page table");
+	}
+	for(int i = 0; i < PAGING_RESERVE; ++i){
+		pool_free[pool_free_count++] = (uint32_t)&pool_reserve[i][0];
 	}
 	
 	// Map the first page table
 	uint64_t address = 0;
-	for(int i = 0; i < 512; ++i){
-		pt[i] = address | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
-		address += 0x1000;
+	for(int i = 0; i < PAGING_ENTRIES; ++i){
+		pt[i] = address | PAGING_KERNEL;
+		address += PAGING_PAGE;
 	}
 	
-	pdpt[0] = (uint64_t)(uint32_t)&pdt[0] | PAGING_FLAG_PRESENT;
-	pdt[0] = (uint64_t)(uint32_t)&pt[0] | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
+	for(int i = 0; i < PAGING_PDPT_SIZE; ++i){
+		pdpt[i] = (uint64_t)(uint32_t)&pdt[i][0] | PAGING_FLAG_PRESENT;
+	}
+	pdt[0][0] = (uint64_t)(uint32_t)&pt[0] | PAGING_FLAG_PRESENT | PAGING_FLAG_RW;
 	
 	// Enable PAE.
 	asm volatile(
@@ -118,5 +599,15 @@ void paging_init(){
 		"orl $0x80000000, %eax;"
 		"movl %eax, %cr0;"
 	);
+	
+	// Enable global pages if supported.
+	if(cpuid(0x00000001).edx & (1 << 13)){
+		asm volatile(
+			"movl %cr4, %eax;"
+			"bts $7, %eax;"
+			"movl %eax, %cr4"
+		);
+		paging_global = true;
+	}
 }
 
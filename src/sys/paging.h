@@ -7,9 +7,90 @@
 #ifndef __SYS_PAGING_H_
 #define __SYS_PAGING_H_
 
+#include <stdint.h>
+
+/**
+ * Page table entry flags.
+ */
+enum {
+	PAGING_FLAG_PRESENT  = 0x0001,    //!< Page is mapped.
+	PAGING_FLAG_RW       = 0x0002,    //!< Page is writable.
+	PAGING_FLAG_USER     = 0x0004,    //!< Page is accessible from user-mode.
+	PAGING_FLAG_WTHROUGH = 0x0008,    //!< Write-through caching.
+	PAGING_FLAG_CACHEDIS = 0x0010,    //!< Caching disabled.
+	PAGING_FLAG_ACCESSED = 0x0020,    //!< Page has been accessed.
+	PAGING_FLAG_DIRTY    = 0x0040,    //!< Page has been written.
+	PAGING_FLAG_PGESIZE  = 0x0080,    //!< Directory entry maps a 2MiB page.
+	PAGING_FLAG_GLOBAL   = 0x0100,    //!< Translation survives address space switches.
+	PAGING_FLAG_GUARD    = 0x0200     //!< Not-present guard page, never mapped on demand.
+};
+
+/**
+ * Paging statistics.
+ */
+typedef struct paging_stats{
+	uint32_t faults;        //!< Number of not-present faults handled.
+	uint32_t fault_rate;    //!< Faults during the last full second.
+	uint32_t tables;        //!< Number of page tables allocated.
+	uint32_t large;         //!< Number of 2MiB pages mapped.
+} paging_stats;
+
 /**
  * Initilizing paging directory and tables.
  */
 void paging_init();
 
+/**
+ * Identity maps all usable RAM above the first 2MiB.
+ * Whole 2MiB blocks inside a usable range are mapped with large pages, so
+ * only the edges of each range and the first 2MiB use page tables.
+ * @return Error code, or EOK if successful.
+ */
+int paging_map_ram();
+
+/**
+ * Maps a range of pages, replacing any existing mappings.
+ * Large pages in the way are split into page tables.
+ * @param virt Virtual address of the first page.
+ * @param phys Physical address of the first page.
+ * @param count Number of pages.
+ * @param flags Any of PAGING_FLAG_RW, USER, WTHROUGH and CACHEDIS.
+ * @return Error code, or EOK if successful.
+ */
+int paging_map(void *virt, uint64_t phys, uint32_t count, uint32_t flags);
+
+/**
+ * Unmaps a range of pages.
+ * A later access faults and is identity mapped like any other unmapped page.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @return Error code, or EOK if successful.
+ */
+int paging_unmap(void *virt, uint32_t count);
+
+/**
+ * Turns a range of pages into guard pages.
+ * Any access to a guard page panics instead of being mapped on demand.
+ * paging_map() makes them usable again.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @return Error code, or EOK if successful.
+ */
+int paging_guard(void *virt, uint32_t count);
+
+/**
+ * Changes the flags of a range of mapped pages.
+ * @param virt Virtual address of the first page.
+ * @param count Number of pages.
+ * @param flags Any of PAGING_FLAG_RW, USER, WTHROUGH and CACHEDIS.
+ * @return Error code, or EOK if successful.
+ */
+int paging_protect(void *virt, uint32_t count, uint32_t flags);
+
+/**
+ * Gets the paging statistics.
+ * @param stats Structure to fill.
+ */
+void paging_get_stats(paging_stats *stats);
+
 #endif
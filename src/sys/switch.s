@@ -0,0 +1,32 @@
+;;
+; @file sys/switch.s
+; Kernel thread context switch.
+; @author Conlan Wesson
+;;
+
+GLOBAL thread_switch
+
+;;
+; Switches to another thread's stack.
+; Saves the registers the C calling convention preserves on the old stack
+; and restores them from the new one, where the new thread's last call to
+; thread_switch() left them.
+; @param [esp+4] Where to save the old stack pointer.
+; @param [esp+8] Stack pointer to switch to.
+;;
+thread_switch:
+	mov   eax, [esp+4]    ; Where to save the old stack pointer.
+	mov   ecx, [esp+8]    ; The new stack pointer.
+	push  ebp
+	push  ebx
+	push  esi
+	push  edi
+	pushfd
+	mov   [eax], esp      ; Save the old thread's stack.
+	mov   esp, ecx        ; Load the new thread's stack.
+	popfd
+	pop   edi
+	pop   esi
+	pop   ebx
+	pop   ebp
+	ret
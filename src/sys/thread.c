@@ -0,0 +1,461 @@
+/**
+ * @file sys/thread.c
+ * Preemptive kernel threads.
+ *
+ * Each processor has a run queue with a list of ready threads per priority
+ * and a bitmap of the lists that are not empty, so the next thread is found
+ * with a single bit scan.  Threads of the same priority share the processor
+ * in time slices.  The clock event ending a slice is only queued while
+ * another thread of that priority is ready, so a lone thread is never
+ * interrupted for nothing.
+ *
+ * A thread that blocks or yields switches stacks directly.  A preempted
+ * thread switches from inside the IRQ handler after the EOI, and returns
+ * from the interrupt when it is picked again.  Only the boot processor is
+ * started, so there is a single run queue for now.
+ * @author Conlan Wesson
+ */
+
+#include "thread.h"
+
+#include <errno.h>
+#include <kernel/int.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "sys/clock.h"
+#include "sys/fpu.h"
+#include "sys/frame.h"
+#include "sys/paging.h"
+
+#define THREAD_SLICE_NS 10000000u    //!< Time slice between threads of the same priority.
+#define THREAD_EFLAGS   0x0002       //!< Flags of a new thread, interrupts disabled until it starts.
+
+/**
+ * Scheduling states of a thread.
+ */
+enum thread_state{
+	THREAD_READY,      //!< Waiting in the run queue.
+	THREAD_RUNNING,    //!< Running on a processor.
+	THREAD_BLOCKED,    //!< Waiting in a thread queue.
+	THREAD_DONE        //!< Exited, waiting to be joined.
+};
+
+/**
+ * A kernel thread.
+ * Kept at the top of its own stack allocation, except for the boot thread.
+ */
+struct thread{
+	fpu_state fpu;              //!< FPU and SSE registers while not running.
+	uint32_t esp;               //!< Stack pointer while not running.
+	uint8_t *stack;             //!< Stack allocation, starting with the guard page.
+	enum thread_state state;    //!< Scheduling state.
+	uint8_t priority;           //!< Priority, higher runs first.
+	thread *next;               //!< Next thread in a run or wait queue.
+	thread_entry entry;         //!< Function to run.
+	void *arg;                  //!< Argument for the function.
+	void *result;               //!< Value returned by the function.
+	thread_queue exited;        //!< Thread waiting for this one to exit.
+	bool joined;                //!< A thread has started joining.
+};
+
+/**
+ * Scheduler state of a processor.
+ */
+typedef struct cpu_sched{
+	thread *current;                      //!< Running thread.
+	thread *idle;                         //!< Thread run when nothing else is ready.
+	bool resched;                         //!< Switch threads at the next chance.
+	uint32_t ready;                       //!< Priorities with a ready thread, a bit each.
+	thread_queue queues[THREAD_PRIOS];    //!< Ready threads of each priority.
+	clock_event slice;                    //!< End of the running thread's time slice.
+} cpu_sched;
+
+/**
+ * Switches to another thread's stack.
+ * @param old_esp Where to save the current stack pointer.
+ * @param new_esp Stack pointer saved by the thread to switch to.
+ */
+void thread_switch(uint32_t *old_esp, uint32_t new_esp);
+
+static thread boot_thread;    //!< The thread that called thread_init().
+static cpu_sched boot_cpu;    //!< Scheduler of the boot processor.
+
+/**
+ * Gets the scheduler of the running processor.
+ * @return The scheduler.
+ */
+static inline cpu_sched *thread_cpu(){
+	return &boot_cpu;
+}
+
+/**
+ * Adds a thread to the back of a queue.
+ * @param queue The queue.
+ * @param t The thread, not in any queue.
+ */
+static inline void queue_push(thread_queue *queue, thread *t){
+	t->next = NULL;
+	if(queue->tail){
+		queue->tail->next = t;
+	}else{
+		queue->head = t;
+	}
+	queue->tail = t;
+}
+
+/**
+ * Removes the thread at the front of a queue.
+ * @param queue The queue.
+ * @return The thread, or NULL if the queue is empty.
+ */
+static inline thread *queue_pop(thread_queue *queue){
+	thread *t = queue->head;
+	if(t){
+		queue->head = t->next;
+		if(!queue->head){
+			queue->tail = NULL;
+		}
+		t->next = NULL;
+	}
+	return t;
+}
+
+/**
+ * Ends the running thread's time slice.
+ * @param event The slice event.
+ */
+static void thread_slice_end(clock_event *event){
+	(void)event;
+	thread_cpu()->resched = true;
+}
+
+/**
+ * Adds a thread to the back of its run queue.
+ * Must be called with interrupts disabled.
+ * @param cpu The scheduler.
+ * @param t The thread.
+ */
+static void thread_enqueue(cpu_sched *cpu, thread *t){
+	t->state = THREAD_READY;
+	queue_push(&cpu->queues[t->priority], t);
+	cpu->ready |= (1u << t->priority);
+}
+
+/**
+ * Makes a thread ready, preempting the running one if it has a lower
+ * priority.
+ * Must be called with interrupts disabled.
+ * @param cpu The scheduler.
+ * @param t The thread.
+ */
+static void thread_ready(cpu_sched *cpu, thread *t){
+	thread_enqueue(cpu, t);
+	if(t->priority > cpu->current->priority){
+		cpu->resched = true;
+	}else if(t->priority == cpu->current->priority && !cpu->slice.queued){
+		clock_event_add(&cpu->slice, clock_ns() + THREAD_SLICE_NS);
+	}
+}
+
+/**
+ * Switches to the highest priority ready thread.
+ * The running thread goes to the back of its run queue, unless it is
+ * blocked or done.
+ * Must be called with interrupts disabled.
+ */
+static void thread_schedule(){
+	cpu_sched *cpu = thread_cpu();
+	thread *prev = cpu->current;
+	cpu->resched = false;
+	if(prev->state == THREAD_RUNNING){
+		thread_enqueue(cpu, prev);
+	}
+	
+	// The idle thread is always ready when it is not running.
+	unsigned int prio = 31 - __builtin_clz(cpu->ready);
+	thread *next = queue_pop(&cpu->queues[prio]);
+	if(!cpu->queues[prio].head){
+		cpu->ready &= ~(1u << prio);
+	}
+	next->state = THREAD_RUNNING;
+	cpu->current = next;
+	
+	if(cpu->queues[prio].head && prio != THREAD_PRIO_IDLE){
+		// Share the processor with the others of this priority.
+		clock_event_add(&cpu->slice, clock_ns() + THREAD_SLICE_NS);
+	}else{
+		clock_event_remove(&cpu->slice);
+	}
+	
+	if(next != prev){
+		fpu_save(&prev->fpu);
+		fpu_restore(&next->fpu);
+		thread_switch(&prev->esp, next->esp);
+	}
+}
+
+/**
+ * First function run on a new thread's stack.
+ */
+static void thread_start(){
+	thread *self = thread_cpu()->current;
+	sti();
+	thread_exit(self->entry(self->arg));
+}
+
+/**
+ * Runs when no other thread is ready.
+ * @param arg Unused.
+ * @return Never returns.
+ */
+static void *thread_idle(void *arg){
+	(void)arg;
+	for(;;){
+		// Any interrupt that readies a thread preempts the idle thread on return.
+		int_wait();
+	}
+	return NULL;
+}
+
+/**
+ * Allocates a thread and its stack, ready to be switched to.
+ * @param entry Function to run.
+ * @param arg Argument for the function.
+ * @param priority Priority of the thread.
+ * @return The thread, or NULL if out of memory.
+ */
+static thread *thread_alloc(thread_entry entry, void *arg, uint8_t priority){
+	uint32_t frames = THREAD_STACK_FRAMES + 1;
+	uint8_t *stack = frame_alloc_contig(frames);
+	if(stack == NULL){
+		return NULL;
+	}
+	if(paging_guard(stack, 1) != EOK){
+		frame_free_contig(stack, frames);
+		return NULL;
+	}
+	
+	// The thread sits at the top of the allocation, its stack grows down from there.
+	uint32_t top = (uint32_t)stack + frames*FRAME_SIZE;
+	thread *t = (thread*)((top - sizeof(thread)) & ~(uint32_t)15);
+	memset(t, 0, sizeof(thread));
+	t->stack = stack;
+	t->entry = entry;
+	t->arg = arg;
+	t->priority = priority;
+	// Start with a copy of the creator's FPU settings.
+	uint32_t flags = int_save();
+	fpu_save(&t->fpu);
+	fpu_restore(&t->fpu);
+	int_restore(flags);
+	
+	// Registers for thread_switch() to pop, returning into thread_start().
+	uint32_t *sp = (uint32_t*)t;
+	*--sp = 0;                           // Return address of thread_start(), which never returns.
+	*--sp = (uint32_t)&thread_start;     // Return address of thread_switch().
+	*--sp = 0;                           // ebp
+	*--sp = 0;                           // ebx
+	*--sp = 0;                           // esi
+	*--sp = 0;                           // edi
+	*--sp = THREAD_EFLAGS;
+	t->esp = (uint32_t)sp;
+	return t;
+}
+
+/**
+ * Frees a thread and its stack.
+ * @param t The thread, which has exited.
+ */
+static void thread_free(thread *t){
+	uint8_t *stack = t->stack;
+	paging_map(stack, (uint32_t)stack, 1, PAGING_FLAG_RW);
+	frame_free_contig(stack, THREAD_STACK_FRAMES + 1);
+}
+
+/**
+ * Turns the caller into the boot thread and starts scheduling.
+ * Must be called after clock_init() and frame_init().
+ * @return Error code, or EOK if successful.
+ */
+int thread_init(){
+	cpu_sched *cpu = thread_cpu();
+	if(cpu->current){
+		return EALREADY;
+	}
+	thread *idle = thread_alloc(&thread_idle, NULL, THREAD_PRIO_IDLE);
+	if(idle == NULL){
+		return ENOMEM;
+	}
+	cpu->slice.handler = &thread_slice_end;
+	boot_thread.priority = THREAD_PRIO_DEFAULT;
+	boot_thread.state = THREAD_RUNNING;
+	
+	uint32_t flags = int_save();
+	cpu->current = &boot_thread;
+	cpu->idle = idle;
+	thread_enqueue(cpu, idle);
+	int_restore(flags);
+	return EOK;
+}
+
+/**
+ * Creates a thread, which may start running before this returns.
+ * The stack is allocated from the frame allocator with a guard page below.
+ * @param out Set to the new thread.
+ * @param entry Function to run.
+ * @param arg Argument for the function.
+ * @param priority Priority from 1 to THREAD_PRIO_MAX, higher runs first.
+ * @return Error code, or EOK if successful.
+ */
+int thread_create(thread **out, thread_entry entry, void *arg, uint8_t priority){
+	if(out == NULL || entry == NULL || priority <= THREAD_PRIO_IDLE || priority > THREAD_PRIO_MAX){
+		return EINVAL;
+	}
+	cpu_sched *cpu = thread_cpu();
+	if(!cpu->current){
+		return EAGAIN;
+	}
+	thread *t = thread_alloc(entry, arg, priority);
+	if(t == NULL){
+		return ENOMEM;
+	}
+	*out = t;
+	
+	uint32_t flags = int_save();
+	thread_ready(cpu, t);
+	if(cpu->resched){
+		thread_schedule();
+	}
+	int_restore(flags);
+	return EOK;
+}
+
+/**
+ * Waits for a thread to exit and frees it.
+ * Each thread may be joined once.
+ * @param t The thread.
+ * @param result Set to the thread's return value, may be NULL.
+ * @return Error code, or EOK if successful.
+ */
+int thread_join(thread *t, void **result){
+	cpu_sched *cpu = thread_cpu();
+	if(t == NULL || t == &boot_thread || t == cpu->idle){
+		return EINVAL;
+	}
+	if(t == cpu->current){
+		return EDEADLK;
+	}
+	uint32_t flags = int_save();
+	if(t->joined){
+		int_restore(flags);
+		return EINVAL;
+	}
+	t->joined = true;
+	while(t->state != THREAD_DONE){
+		thread_wait(&t->exited);
+	}
+	int_restore(flags);
+	
+	if(result){
+		*result = t->result;
+	}
+	thread_free(t);
+	return EOK;
+}
+
+/**
+ * Ends the calling thread.
+ * @param result Value for thread_join().
+ */
+void thread_exit(void *result){
+	cli();
+	thread *self = thread_cpu()->current;
+	self->result = result;
+	self->state = THREAD_DONE;
+	thread_wake_all(&self->exited);
+	thread_schedule();
+	for(;;){
+		// Never picked again.
+	}
+}
+
+/**
+ * Lets other threads of the same or higher priority run.
+ */
+void thread_yield(){
+	uint32_t flags = int_save();
+	if(thread_cpu()->current){
+		thread_schedule();
+	}
+	int_restore(flags);
+}
+
+/**
+ * Gets the calling thread.
+ * @return The thread, or NULL before thread_init().
+ */
+thread *thread_self(){
+	return thread_cpu()->current;
+}
+
+/**
+ * Blocks the calling thread until it is woken from the queue.
+ * Must be called with interrupts disabled, which stay disabled.  Callers
+ * check their condition again on return.  Before thread_init() this halts
+ * until the next interrupt instead.
+ * @param queue The queue to wait in.
+ */
+void thread_wait(thread_queue *queue){
+	cpu_sched *cpu = thread_cpu();
+	if(!cpu->current){
+		int_wait();
+		cli();
+		return;
+	}
+	thread *self = cpu->current;
+	self->state = THREAD_BLOCKED;
+	queue_push(queue, self);
+	thread_schedule();
+}
+
+/**
+ * Wakes the first thread waiting in a queue.
+ * Safe to call from interrupt handlers.  A woken thread with a higher
+ * priority runs when the interrupt returns, or from a thread at the next
+ * interrupt or yield.
+ * @param queue The queue.
+ * @return true if a thread was woken.
+ */
+bool thread_wake(thread_queue *queue){
+	uint32_t flags = int_save();
+	thread *t = queue_pop(queue);
+	if(t){
+		thread_ready(thread_cpu(), t);
+	}
+	int_restore(flags);
+	return t != NULL;
+}
+
+/**
+ * Wakes every thread waiting in a queue.
+ * @param queue The queue.
+ */
+void thread_wake_all(thread_queue *queue){
+	while(thread_wake(queue)){
+		// Wake the next one.
+	}
+}
+
+/**
+ * Switches threads if the running one should be preempted.
+ * Called at the end of each IRQ, after the EOI, and by threads that woke
+ * another.  Must be called with interrupts disabled.
+ */
+void thread_preempt(){
+	cpu_sched *cpu = thread_cpu();
+	if(cpu->current && cpu->resched){
+		thread_schedule();
+	}
+}
@@ -0,0 +1,112 @@
+/**
+ * @file sys/thread.h
+ * Preemptive kernel threads.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_THREAD_H_
+#define __SYS_THREAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define THREAD_PRIOS        32    //!< Number of priorities.
+#define THREAD_PRIO_IDLE    0     //!< Priority of the idle thread, lower than any other.
+#define THREAD_PRIO_DEFAULT 16    //!< Priority of the boot thread and new threads.
+#define THREAD_PRIO_MAX     (THREAD_PRIOS - 1)    //!< Highest priority.
+#define THREAD_STACK_FRAMES 4     //!< Stack size of new threads in frames.
+
+typedef struct thread thread;
+
+/**
+ * Function run by a thread.
+ * @param arg Argument passed to thread_create().
+ * @return Value passed to thread_join().
+ */
+typedef void *(*thread_entry)(void *arg);
+
+/**
+ * Threads waiting for something, in the order they started waiting.
+ */
+typedef struct thread_queue{
+	thread *head;    //!< First thread to wake.
+	thread *tail;    //!< Last thread to wake.
+} thread_queue;
+
+/**
+ * Turns the caller into the boot thread and starts scheduling.
+ * Must be called after clock_init() and frame_init().
+ * @return Error code, or EOK if successful.
+ */
+int thread_init();
+
+/**
+ * Creates a thread, which may start running before this returns.
+ * The stack is allocated from the frame allocator with a guard page below.
+ * @param out Set to the new thread.
+ * @param entry Function to run.
+ * @param arg Argument for the function.
+ * @param priority Priority from 1 to THREAD_PRIO_MAX, higher runs first.
+ * @return Error code, or EOK if successful.
+ */
+int thread_create(thread **out, thread_entry entry, void *arg, uint8_t priority);
+
+/**
+ * Waits for a thread to exit and frees it.
+ * Each thread may be joined once.
+ * @param t The thread.
+ * @param result Set to the thread's return value, may be NULL.
+ * @return Error code, or EOK if successful.
+ */
+int thread_join(thread *t, void **result);
+
+/**
+ * Ends the calling thread.
+ * @param result Value for thread_join().
+ */
+void thread_exit(void *result) __attribute__((noreturn));
+
+/**
+ * Lets other threads of the same or higher priority run.
+ */
+void thread_yield();
+
+/**
+ * Gets the calling thread.
+ * @return The thread, or NULL before thread_init().
+ */
+thread *thread_self();
+
+/**
+ * Blocks the calling thread until it is woken from the queue.
+ * Must be called with interrupts disabled, which stay disabled.  Callers
+ * check their condition again on return.  Before thread_init() this halts
+ * until the next interrupt instead.
+ * @param queue The queue to wait in.
+ */
+void thread_wait(thread_queue *queue);
+
+/**
+ * Wakes the first thread waiting in a queue.
+ * Safe to call from interrupt handlers.  A woken thread with a higher
+ * priority runs when the interrupt returns, or from a thread at the next
+ * interrupt or yield.
+ * @param queue The queue.
+ * @return true if a thread was woken.
+ */
+bool thread_wake(thread_queue *queue);
+
+/**
+ * Wakes every thread waiting in a queue.
+ * @param queue The queue.
+ */
+void thread_wake_all(thread_queue *queue);
+
+/**
+ * Switches threads if the running one should be preempted.
+ * Called at the end of each IRQ, after the EOI, and by threads that woke
+ * another.  Must be called with interrupts disabled.
+ */
+void thread_preempt();
+
+#endif /* __SYS_THREAD_H_ */
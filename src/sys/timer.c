@@ -0,0 +1,292 @@
+/**
+ * @file sys/timer.c
+ * Kernel timers and sleeps on a hierarchical timing wheel.
+ *
+ * The wheel has four levels of 64 slots.  Level 0 holds timers due within
+ * 64 ticks, one slot per tick, and each level above covers 64 times the
+ * span of the one below.  Adding or cancelling a timer only links or
+ * unlinks it from a slot.  When the wheel passes a slot boundary of a
+ * higher level that slot is cascaded, its timers move down to where they
+ * now belong.
+ *
+ * A bitmap per level records which slots hold timers, so the next tick
+ * with something to do is found without walking the slots.  The wheel is
+ * driven by a single clock event for that tick, only queued while a timer
+ * is pending, so an idle wheel costs no interrupts.
+ * @author Conlan Wesson
+ */
+
+#include "timer.h"
+
+#include <kernel/int.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dev/pit.h"
+#include "sys/clock.h"
+#include "sys/thread.h"
+
+#define TIMER_TICK_SHIFT 20                                  //!< A tick is 2^20ns, about a millisecond.
+#define TIMER_TICK_NS    (1ull << TIMER_TICK_SHIFT)          //!< Nanoseconds per tick.
+#define TIMER_SLOT_BITS  6                                   //!< Bits of the tick indexing each level.
+#define TIMER_SLOTS      (1 << TIMER_SLOT_BITS)              //!< Slots per level.
+#define TIMER_LEVELS     4                                   //!< Number of levels.
+#define TIMER_SPAN       (1ull << (TIMER_SLOT_BITS * TIMER_LEVELS))    //!< Ticks covered by the wheel.
+#define TIMER_DELAY_MAX  50                                  //!< Longest PIT wait in milliseconds.
+
+static void timer_run(clock_event *event);
+
+static timer *wheel[TIMER_LEVELS][TIMER_SLOTS];    //!< Pending timers in each slot.
+static uint64_t occupied[TIMER_LEVELS];            //!< Slots holding timers, a bit per slot.
+static uint64_t wheel_tick = 0;                    //!< Next tick to process.
+static uint32_t pending = 0;                       //!< Number of pending timers.
+static bool dispatching = false;                   //!< Running expired timers.
+static clock_event wheel_event = {.handler = &timer_run};    //!< Wakes up for the next tick.
+
+/**
+ * Finds the lowest set bit.
+ * @param bits Bits to search, not zero.
+ * @return Index of the lowest set bit.
+ */
+static inline unsigned int timer_lowest(uint64_t bits){
+	uint32_t lo = (uint32_t)bits;
+	return lo ? (unsigned int)__builtin_ctz(lo) : 32 + (unsigned int)__builtin_ctz((uint32_t)(bits >> 32));
+}
+
+/**
+ * Links a timer into the slot for its expiry.
+ * Timers beyond the wheel go in the furthest slot and are placed again
+ * when it cascades.
+ * Must be called with interrupts disabled.
+ * @param t The timer, not linked.
+ */
+static void timer_place(timer *t){
+	uint64_t expires = (t->expires > wheel_tick) ? t->expires : wheel_tick;
+	if(expires - wheel_tick >= TIMER_SPAN){
+		expires = wheel_tick + TIMER_SPAN - 1;
+	}
+	uint64_t delta = expires - wheel_tick;
+	unsigned int level = 0;
+	while(delta >> (TIMER_SLOT_BITS * (level + 1))){
+		++level;
+	}
+	unsigned int index = (expires >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1);
+	
+	timer **head = &wheel[level][index];
+	t->next = *head;
+	if(t->next){
+		t->next->pprev = &t->next;
+	}
+	t->pprev = head;
+	*head = t;
+	t->slot = level*TIMER_SLOTS + index;
+	occupied[level] |= (1ull << index);
+}
+
+/**
+ * Unlinks a timer from its slot.
+ * Must be called with interrupts disabled.
+ * @param t The timer, linked.
+ */
+static void timer_unlink(timer *t){
+	*t->pprev = t->next;
+	if(t->next){
+		t->next->pprev = t->pprev;
+	}
+	t->next = NULL;
+	t->pprev = NULL;
+	unsigned int level = t->slot / TIMER_SLOTS;
+	unsigned int index = t->slot % TIMER_SLOTS;
+	if(!wheel[level][index]){
+		occupied[level] &= ~(1ull << index);
+	}
+}
+
+/**
+ * Finds the next tick with a slot to run or cascade.
+ * Must be called with interrupts disabled and a timer pending.
+ * @return The tick.
+ */
+static uint64_t timer_next(){
+	uint64_t next = UINT64_MAX;
+	for(unsigned int level = 0; level < TIMER_LEVELS; ++level){
+		if(!occupied[level]){
+			continue;
+		}
+		// The first tick at or after wheel_tick where this level is looked at.
+		unsigned int shift = TIMER_SLOT_BITS * level;
+		uint64_t unit = 1ull << shift;
+		uint64_t first = (wheel_tick + unit - 1) & ~(unit - 1);
+		unsigned int index = (first >> shift) & (TIMER_SLOTS - 1);
+		uint64_t ahead = occupied[level];
+		if(index){
+			ahead = (ahead >> index) | (ahead << (TIMER_SLOTS - index));
+		}
+		uint64_t tick = first + timer_lowest(ahead)*unit;
+		if(tick < next){
+			next = tick;
+		}
+	}
+	return next;
+}
+
+/**
+ * Queues the wheel's clock event for the next tick, or removes it if the
+ * wheel is empty.
+ * Must be called with interrupts disabled.
+ */
+static void timer_arm(){
+	if(!pending){
+		clock_event_remove(&wheel_event);
+		return;
+	}
+	uint64_t expires = timer_next() << TIMER_TICK_SHIFT;
+	if(!wheel_event.queued || wheel_event.expires != expires){
+		clock_event_add(&wheel_event, expires);
+	}
+}
+
+/**
+ * Processes the wheel up to a tick, running expired timers.
+ * Must be called with interrupts disabled.
+ * @param now The current tick.
+ */
+static void timer_process(uint64_t now){
+	dispatching = true;
+	while(pending && timer_next() <= now){
+		wheel_tick = timer_next();
+		// Cascade each level whose slot boundary this is.
+		for(unsigned int level = 1; level < TIMER_LEVELS; ++level){
+			unsigned int shift = TIMER_SLOT_BITS * level;
+			if(wheel_tick & ((1ull << shift) - 1)){
+				break;
+			}
+			unsigned int index = (wheel_tick >> shift) & (TIMER_SLOTS - 1);
+			timer *list = wheel[level][index];
+			wheel[level][index] = NULL;
+			occupied[level] &= ~(1ull << index);
+			while(list){
+				timer *t = list;
+				list = t->next;
+				timer_place(t);
+			}
+		}
+		
+		// Detach the due slot first, handlers may add timers that land in it.
+		unsigned int index = wheel_tick & (TIMER_SLOTS - 1);
+		timer *list = wheel[0][index];
+		wheel[0][index] = NULL;
+		occupied[0] &= ~(1ull << index);
+		if(list){
+			list->pprev = &list;
+		}
+		++wheel_tick;
+		while(list){
+			timer *t = list;
+			timer_unlink(t);
+			--pending;
+			t->handler(t);
+		}
+	}
+	dispatching = false;
+}
+
+/**
+ * Clock event handler for the wheel.
+ * @param event The wheel's clock event.
+ */
+static void timer_run(clock_event *event){
+	(void)event;
+	timer_process(clock_ns() >> TIMER_TICK_SHIFT);
+	timer_arm();
+}
+
+/**
+ * Starts a timer, moving it if it is already pending.
+ * Timers have a resolution of about a millisecond and never run early.
+ * @param t The timer, with handler set.
+ * @param msec Milliseconds from now to run the handler.
+ */
+void timer_add(timer *t, uint32_t msec){
+	uint32_t flags = int_save();
+	if(t->pprev){
+		timer_unlink(t);
+		--pending;
+	}
+	uint64_t now = clock_ns();
+	if(!pending && (now >> TIMER_TICK_SHIFT) > wheel_tick){
+		// Nothing to process in between, skip the empty wheel ahead.
+		wheel_tick = now >> TIMER_TICK_SHIFT;
+	}
+	t->expires = (now + msec*1000000ull + TIMER_TICK_NS - 1) >> TIMER_TICK_SHIFT;
+	timer_place(t);
+	++pending;
+	if(!dispatching){
+		timer_arm();
+	}
+	int_restore(flags);
+}
+
+/**
+ * Stops a pending timer.
+ * @param t The timer.
+ * @return true if the timer was pending.
+ */
+bool timer_cancel(timer *t){
+	uint32_t flags = int_save();
+	bool ret = (t->pprev != NULL);
+	if(ret){
+		timer_unlink(t);
+		--pending;
+		if(!dispatching){
+			timer_arm();
+		}
+	}
+	int_restore(flags);
+	return ret;
+}
+
+/**
+ * A thread sleeping in ksleep().
+ */
+typedef struct sleeper{
+	bool done;             //!< The sleep is over.
+	thread_queue queue;    //!< The sleeping thread.
+} sleeper;
+
+/**
+ * Wakes up a sleeper.
+ * @param t The sleeper's timer.
+ */
+static void ksleep_wake(timer *t){
+	sleeper *s = t->data;
+	s->done = true;
+	thread_wake(&s->queue);
+}
+
+/**
+ * Sleeps for a while.
+ * Blocks the calling thread until the timer expires if interrupts are
+ * enabled, otherwise waits on the PIT.
+ * @param msec Milliseconds to sleep.
+ */
+void ksleep(uint32_t msec){
+	uint32_t flags = int_save();
+	if(!(flags & 0x200) || !clock_running()){
+		// No interrupt will come, busy wait instead.
+		int_restore(flags);
+		while(msec){
+			uint32_t chunk = (msec < TIMER_DELAY_MAX) ? msec : TIMER_DELAY_MAX;
+			pit_delay(chunk*1000);
+			msec -= chunk;
+		}
+		return;
+	}
+	sleeper s = {false, {NULL, NULL}};
+	timer t = {.handler = &ksleep_wake, .data = &s};
+	timer_add(&t, msec);
+	while(!*(volatile bool*)&s.done){
+		thread_wait(&s.queue);
+	}
+	int_restore(flags);
+}
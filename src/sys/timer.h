@@ -0,0 +1,66 @@
+/**
+ * @file sys/timer.h
+ * Kernel timers and sleeps on a hierarchical timing wheel.
+ * @author Conlan Wesson
+ */
+
+#ifndef __SYS_TIMER_H_
+#define __SYS_TIMER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct timer timer;
+
+/**
+ * Function called from the timer interrupt when a timer expires.
+ * @param t The expired timer, which may be added again.
+ */
+typedef void (*timer_handler)(timer *t);
+
+/**
+ * A timer, owned by the caller until it expires or is cancelled.
+ */
+struct timer{
+	uint64_t expires;         //!< Wheel tick to run at.
+	timer_handler handler;    //!< Function to call.
+	void *data;               //!< Free for the handler's use.
+	timer *next;              //!< Next timer in the wheel slot.
+	timer **pprev;            //!< Link pointing at this timer, NULL if not pending.
+	uint16_t slot;            //!< Wheel level and slot holding the timer.
+};
+
+/**
+ * Starts a timer, moving it if it is already pending.
+ * Timers have a resolution of about a millisecond and never run early.
+ * @param t The timer, with handler set.
+ * @param msec Milliseconds from now to run the handler.
+ */
+void timer_add(timer *t, uint32_t msec);
+
+/**
+ * Stops a pending timer.
+ * @param t The timer.
+ * @return true if the timer was pending.
+ */
+bool timer_cancel(timer *t);
+
+/**
+ * Checks if a timer is waiting to run.
+ * @param t The timer.
+ * @return true if the timer is pending.
+ */
+static inline bool timer_pending(const timer *t){
+	return t->pprev != NULL;
+}
+
+/**
+ * Sleeps for a while.
+ * Blocks the calling thread until the timer expires if interrupts are
+ * enabled, otherwise waits on the PIT.
+ * @param msec Milliseconds to sleep.
+ */
+void ksleep(uint32_t msec);
+
+#endif /* __SYS_TIMER_H_ */
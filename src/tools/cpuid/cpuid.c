@@ -6,40 +6,16 @@
 
 #include "cpuid.h"
 
+#include <kernel/cpuid.h>
 #include <stdbool.h>
 #include <stdio.h>
 
-/**
- * Struct for returning CPUID outputs.
- */
-struct cpuid_out{
-	int eax;  //!< Contents of the EAX register.
-	int ebx;  //!< Contents of the EBX register.
-	int ecx;  //!< Contents of the ECX register.
-	int edx;  //!< Contents of the EDX register.
-};
-
 /**
  * Checks if CPUID is supported by the processor.
  * @return true if supported, false otherwise.
  */
 extern bool cpuid_allowed();
 
-/**
- * Runs a CPUID instruction.
- * @param func The function code to run CPUID.
- * @return Register output of the CPUID instruction.
- */
-static inline struct cpuid_out cpuid(int func){
-	struct cpuid_out out;
-	asm volatile(
-		"cpuid;"
-		:"=a"(out.eax), "=b"(out.ebx), "=c"(out.ecx), "=d"(out.edx)
-		:"eax"(func)
-	);
-	return out;
-}
-
 /**
  * Checks the vendor of the CPU.
  * @param vendor Location to store the output string, must be at least 13bytes.
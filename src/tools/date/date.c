@@ -9,7 +9,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "dev/rtc.h"
+#include <time.h>
 
 //! Array of full month names.
 const char *date_months[] = {
@@ -38,7 +38,8 @@ const char *date_week_days_short[] = {
  */
 void date_print(){
 	struct tm dt;
-	rtc_time(&dt);
+	time_t now = time(NULL);
+	gmtime_r(&now, &dt);
 	printf("%s %04d-%02d-%02d %02d:%02d:%02d\n", date_week_days_short[dt.tm_wday],
 			dt.tm_year+1900, dt.tm_mon+1, dt.tm_mday, dt.tm_hour, dt.tm_min, dt.tm_sec);
 }
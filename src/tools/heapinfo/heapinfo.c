@@ -0,0 +1,49 @@
+/**
+ * @file tools/heapinfo/heapinfo.c
+ * Functions for inspecting the heap.
+ * @author Conlan Wesson
+ */
+
+#include "heapinfo.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+	HEAPINFO_TRACE = 16    //!< Number of trace entries to print.
+};
+
+static bool heapinfo_tracing = false;    //!< The allocation trace is on.
+
+/**
+ * Prints the heap statistics and the allocation trace.
+ */
+void heapinfo_print(){
+	heap_stats stats;
+	heap_get_stats(&stats);
+	printf("%u bytes used, %u peak\n", stats.used, stats.peak);
+	printf("%u bytes free, %u largest, %u%% fragmented\n", stats.free, stats.largest, stats.fragmentation);
+	printf("%u allocations, %u frees\n", stats.allocs, stats.frees);
+	for(int i = 0; i < HEAP_STAT_CLASSES - 1; ++i){
+		printf("%5u:%-7u", 16u << i, stats.class_allocs[i]);
+	}
+	printf("large:%u\n", stats.class_allocs[HEAP_STAT_CLASSES - 1]);
+	
+	heap_trace_entry trace[HEAPINFO_TRACE];
+	size_t count = heap_trace_read(trace, HEAPINFO_TRACE);
+	for(size_t i = 0; i < count; ++i){
+		printf("%c 0x%08X %8u from 0x%08X\n", trace[i].alloc ? '+' : '-',
+			(uint32_t)trace[i].ptr, trace[i].size, (uint32_t)trace[i].caller);
+	}
+}
+
+/**
+ * Turns the allocation trace on or off.
+ */
+void heapinfo_trace(){
+	heapinfo_tracing = !heapinfo_tracing;
+	heap_trace(heapinfo_tracing);
+	printf("Heap trace %s\n", heapinfo_tracing ? "on" : "off");
+}
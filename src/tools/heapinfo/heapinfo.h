@@ -0,0 +1,20 @@
+/**
+ * @file tools/heapinfo/heapinfo.h
+ * Functions for inspecting the heap.
+ * @author Conlan Wesson
+ */
+
+#ifndef TOOLS_HEAPINFO_HEAPINFO_H
+#define TOOLS_HEAPINFO_HEAPINFO_H
+
+/**
+ * Prints the heap statistics and the allocation trace.
+ */
+void heapinfo_print();
+
+/**
+ * Turns the allocation trace on or off.
+ */
+void heapinfo_trace();
+
+#endif
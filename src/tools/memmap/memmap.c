@@ -9,6 +9,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "dev/ram.h"
+#include "sys/frame.h"
+#include "sys/paging.h"
 
 /**
  * Prints the memory map.
@@ -17,9 +19,17 @@ void memmap_print(){
 	struct mmap_entry *mmap = ram_mmap();
 	uint32_t length = ram_mmap_length();
 	uint32_t addr = (uint32_t)mmap;
+	// Write the whole map at once.
+	int mode = stdout->mode;
+	setvbuf(stdout, NULL, _IOFBF, 0);
 	while((uint32_t)mmap < addr + length){
-		printf("0x%08X  %10uB Type %u\n", (uint32_t)mmap->addr, (uint32_t)mmap->len, mmap->type);
+		printf("0x%016llX  %12lluB Type %u\n", mmap->addr, mmap->len, mmap->type);
 		mmap = (struct mmap_entry*)((uint32_t)mmap + mmap->size + sizeof(uint32_t));
 	}
+	printf("%u of %u frames free\n", frame_count_free(), frame_count_total());
+	paging_stats stats;
+	paging_get_stats(&stats);
+	printf("%u page faults, %u/s, %u page tables, %u large pages\n", stats.faults, stats.fault_rate, stats.tables, stats.large);
+	setvbuf(stdout, NULL, mode, 0);
 }
 
@@ -0,0 +1,99 @@
+/**
+ * @file tools/tlbbench/tlbbench.c
+ * Benchmark for TLB miss cost.
+ *
+ * Reads one word from each 4KiB page of a block of RAM in a scattered order,
+ * so nearly every read needs a new translation.  With 2MiB pages the whole
+ * block fits in a handful of TLB entries, with 4KiB pages every read misses.
+ * @author Conlan Wesson
+ */
+
+#include "tlbbench.h"
+
+#include <kernel/tsc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "dev/ram.h"
+#include "sys/paging.h"
+
+#define TLBBENCH_START  0x01000000u    //!< Start of the block to read, above the kernel.
+#define TLBBENCH_PAGE   0x1000u        //!< Distance between reads.
+#define TLBBENCH_STRIDE 4093u          //!< Odd step, visits every page of a power of two block once.
+
+enum {
+	TLBBENCH_MAX_SHIFT  = 14,    //!< log2 of the most pages to read, 64MiB.
+	TLBBENCH_MIN_SHIFT  = 8,     //!< log2 of the fewest pages worth reading.
+	TLBBENCH_PASS_SHIFT = 3     //!< log2 of the number of timed passes.
+};
+
+/**
+ * Finds the end of the usable memory block containing an address.
+ * @param addr Address in the block.
+ * @return End of the block, or 0 if the address is not usable.
+ */
+static uint64_t tlbbench_block_end(uint64_t addr){
+	struct mmap_entry *mmap = ram_mmap();
+	uint32_t end_map = (uint32_t)mmap + ram_mmap_length();
+	while((uint32_t)mmap < end_map){
+		if(mmap->type == RAM_BLOCK_USABLE && mmap->addr <= addr && addr < mmap->addr + mmap->len){
+			return mmap->addr + mmap->len;
+		}
+		mmap = (struct mmap_entry*)((uint32_t)mmap + mmap->size + sizeof(uint32_t));
+	}
+	return 0;
+}
+
+/**
+ * Reads one word from every page of the block.
+ * @param shift log2 of the number of pages.
+ * @return Cycles taken.
+ */
+static uint64_t tlbbench_pass(uint32_t shift){
+	const uint32_t mask = (1u << shift) - 1;
+	volatile uint32_t *base = (volatile uint32_t*)TLBBENCH_START;
+	uint32_t sum = 0;
+	uint64_t start = rdtsc();
+	for(uint32_t i = 0; i <= mask; ++i){
+		uint32_t page = (i * TLBBENCH_STRIDE) & mask;
+		sum += base[page * (TLBBENCH_PAGE / sizeof(uint32_t))];
+	}
+	uint64_t end = rdtsc();
+	(void)sum;
+	return end - start;
+}
+
+/**
+ * Reads one word from each page of a large block of RAM and prints the
+ * average number of cycles per read.
+ */
+void tlbbench_run(){
+	uint64_t end = tlbbench_block_end(TLBBENCH_START);
+	uint32_t shift = TLBBENCH_MAX_SHIFT;
+	while(shift >= TLBBENCH_MIN_SHIFT && TLBBENCH_START + ((uint64_t)TLBBENCH_PAGE << shift) > end){
+		--shift;
+	}
+	if(shift < TLBBENCH_MIN_SHIFT){
+		puts("Not enough memory for benchmark\n");
+		return;
+	}
+	
+	paging_stats stats;
+	paging_get_stats(&stats);
+	printf("%u pages, %u large pages mapped\n", 1u << shift, stats.large);
+	
+	// Warm up, this also faults in any pages that are not mapped yet.
+	tlbbench_pass(shift);
+	
+	uint64_t total = 0;
+	uint64_t best = ~0ull;
+	for(int i = 0; i < (1 << TLBBENCH_PASS_SHIFT); ++i){
+		uint64_t cycles = tlbbench_pass(shift);
+		total += cycles;
+		if(cycles < best){
+			best = cycles;
+		}
+	}
+	// Page count and passes are powers of two, so shifts do the division.
+	printf("%u cycles/read average, %u cycles/read best\n",
+		(uint32_t)(total >> (shift + TLBBENCH_PASS_SHIFT)), (uint32_t)(best >> shift));
+}
@@ -0,0 +1,16 @@
+/**
+ * @file tools/tlbbench/tlbbench.h
+ * Benchmark for TLB miss cost.
+ * @author Conlan Wesson
+ */
+
+#ifndef TOOLS_TLBBENCH_TLBBENCH_H
+#define TOOLS_TLBBENCH_TLBBENCH_H
+
+/**
+ * Reads one word from each page of a large block of RAM and prints the
+ * average number of cycles per read.
+ */
+void tlbbench_run();
+
+#endif